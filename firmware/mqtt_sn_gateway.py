@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+"""Stand-in for an MQTT-SN gateway, to test the MQTT-SN publisher locally.
+
+Accepts every CONNECT, answers pings and prints the PUBLISHes it receives,
+decoding snapshot topic payloads, see Snapshots in docs/modbus_registers.md.
+"""
+import argparse
+import socket
+import struct
+
+CONNECT, CONNACK, PUBLISH, PINGREQ, PINGRESP, DISCONNECT = 0x04, 0x05, 0x0c, 0x16, 0x17, 0x18
+
+
+def varint(payload, pos):
+    value, shift = 0, 0
+    while True:
+        byte = payload[pos]
+        value |= (byte & 0x7f) << shift
+        pos += 1
+        shift += 7
+        if not byte & 0x80:
+            return (value >> 1) ^ -(value & 1), pos
+
+
+# Meter energy in and out, active and reactive, and net meter energy
+COUNTERS = (1, 2, 3, 4, 26)
+
+# Counters of the last snapshot with all items, (generation, {item: value})
+base = (None, {})
+
+
+def decode_snapshot(payload):
+    global base
+    magic, version, flags, count, generation = struct.unpack_from(">cBBBI", payload)
+    if magic != b"S" or version != 1:
+        return f"unknown format {payload.hex()}"
+    pos = 8
+    if flags & 4:
+        base_generation = struct.unpack_from(">I", payload, pos)[0]
+        pos += 4
+    if flags & 1 and generation != base[0]:
+        base = (generation, {})
+    values = []
+    for _ in range(count):
+        item = payload[pos] & 0x3f
+        delta = payload[pos] & 0x80
+        value, pos = varint(payload, pos + 1)
+        if flags & 8:
+            _, pos = varint(payload, pos)
+        if delta:
+            if base[0] != base_generation or item not in base[1]:
+                values.append(f"{item}=?")
+                continue
+            value += base[1][item]
+        elif flags & 1 and item in COUNTERS:
+            base[1][item] = value
+        values.append(f"{item}={value}")
+    more = " more" if flags & 2 else ""
+    full = " full" if flags & 1 else ""
+    return f"generation {generation}{full}{more}: {' '.join(values)}"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--port", type=int, default=10000)
+    parser.add_argument("--snapshot-topic", type=int, default=1)
+    parser.add_argument("--item-topic-base", type=int, default=256)
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+    sock.bind(("::", args.port))
+    print(f"Listening on port {args.port}")
+    while True:
+        msg, client = sock.recvfrom(1024)
+        if len(msg) < 2 or msg[0] != len(msg):
+            print(f"{client[0]}: malformed {msg.hex()}")
+            continue
+        kind = msg[1]
+        if kind == CONNECT:
+            print(f"{client[0]}: CONNECT {msg[6:].decode()}, keep alive {struct.unpack_from('>H', msg, 4)[0]} s")
+            sock.sendto(bytes([3, CONNACK, 0]), client)
+        elif kind == PINGREQ:
+            sock.sendto(bytes([2, PINGRESP]), client)
+        elif kind == DISCONNECT:
+            print(f"{client[0]}: DISCONNECT")
+            sock.sendto(bytes([2, DISCONNECT]), client)
+        elif kind == PUBLISH:
+            topic = struct.unpack_from(">H", msg, 3)[0]
+            payload = msg[7:]
+            if topic == args.snapshot_topic:
+                print(f"{client[0]}: snapshot {decode_snapshot(payload)}")
+            elif topic >= args.item_topic_base:
+                print(f"{client[0]}: item {topic - args.item_topic_base} = {payload.decode()}")
+            else:
+                print(f"{client[0]}: topic {topic} {payload.hex()}")
+        else:
+            print(f"{client[0]}: type 0x{kind:02x} {msg.hex()}")
+
+
+if __name__ == "__main__":
+    main()
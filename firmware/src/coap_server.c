@@ -0,0 +1,410 @@
+#include "coap_server.h"
+#include "lib/cbor.h"
+#include "lib/push.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(coap_server, LOG_LEVEL_DBG);
+
+#if CONFIG_OPENP1_COAP
+
+#include <zephyr/net/socket.h>
+#include <zephyr/net/coap.h>
+#include <zephyr/net/coap_link_format.h>
+
+#define COAP_PORT 5683
+#define STACK_SIZE 3072
+#define RECEIVE_THREAD_PRIORITY 8
+#define MAX_COAP_MSG_LEN 256
+#define MAX_OPTIONS 8
+#define MAX_OBSERVERS CONFIG_OPENP1_COAP_MAX_OBSERVERS
+#define NUMBER_LEN 4
+// Confirmable notifications left unacknowledged before an observer is dropped,
+// as MAX_RETRANSMIT of RFC 7252
+#define MAX_UNACKED 4
+
+// Numeric items at items/<item number>, the snapshot, .well-known/core and the
+// terminating entry
+#define MAX_RESOURCES (_ITEM_COUNT + 3)
+#define SNAPSHOT ((void *) (uintptr_t) _ITEM_COUNT)
+
+static struct value_store *value_store;
+static int sock = -1;
+
+static char item_numbers[_ITEM_COUNT][NUMBER_LEN];
+static const char *item_paths[_ITEM_COUNT][3];
+static const char *const snapshot_path[] = { "snapshot", NULL };
+static const char *const well_known_path[] = COAP_WELL_KNOWN_CORE_PATH;
+static struct coap_resource resources[MAX_RESOURCES];
+static struct coap_resource *item_resources[_ITEM_COUNT];
+static struct coap_resource *snapshot_resource;
+
+static struct coap_observer observers[MAX_OBSERVERS];
+// Confirmable notifications of each observer, at the same index
+struct observer_state {
+	uint16_t notifications;	// Since the last confirmable one
+	uint16_t con_id;	// Message ID of the last confirmable one
+	uint8_t unacked;	// Confirmable ones sent since the last ACK
+};
+static struct observer_state observer_states[MAX_OBSERVERS];
+// Taken around request handling and notifications, which both walk the observers
+K_MUTEX_DEFINE(coap_lock);
+
+static const struct push_config notify_config = {
+	.min_interval_ms = CONFIG_OPENP1_COAP_MIN_INTERVAL_MS,
+	.full_interval_ms = CONFIG_OPENP1_COAP_MAX_AGE_S * MSEC_PER_SEC,
+	.deadband = CONFIG_OPENP1_COAP_DEADBAND,
+};
+static struct push_state notify_state;
+
+static uint8_t rx_buf[MAX_COAP_MSG_LEN];
+static uint8_t tx_buf[MAX_COAP_MSG_LEN];
+static uint8_t payload[MAX_COAP_MSG_LEN - 32];
+
+static int send_packet(struct coap_packet *packet, const struct sockaddr *addr, socklen_t addr_len) {
+	// Notifications are sent from the publish queue, which must not wait for buffers
+	int ret = sendto(sock, packet->data, packet->offset, ZSOCK_MSG_DONTWAIT, addr, addr_len);
+	if (ret < 0) {
+		LOG_ERR("Failed to send: %d", errno);
+		return -errno;
+	}
+	return 0;
+}
+
+static int encode_payload(struct coap_resource *resource) {
+	int len;
+	value_store_lock(value_store);
+	if (resource->user_data == SNAPSHOT) {
+		len = cbor_encode_snapshot(value_store, payload, sizeof(payload));
+	} else {
+		len = cbor_encode_item(value_store, (uintptr_t) resource->user_data, payload, sizeof(payload));
+	}
+	value_store_unlock(value_store);
+	return len;
+}
+
+// Writes the representation of resource, as a response or a notification
+static int send_representation(struct coap_resource *resource, const struct sockaddr *addr, socklen_t addr_len,
+			       uint8_t type, uint16_t id, const uint8_t *token, uint8_t tkl, bool observe) {
+	struct coap_packet response;
+	int len = encode_payload(resource);
+
+	if (len < 0) {
+		LOG_ERR("Payload too large");
+		return len;
+	}
+
+	int ret = coap_packet_init(&response, tx_buf, sizeof(tx_buf), COAP_VERSION_1, type, tkl, token,
+				   COAP_RESPONSE_CODE_CONTENT, id);
+	if (ret == 0 && observe) {
+		ret = coap_append_option_int(&response, COAP_OPTION_OBSERVE, resource->age);
+	}
+	if (ret == 0) {
+		ret = coap_append_option_int(&response, COAP_OPTION_CONTENT_FORMAT, COAP_CONTENT_FORMAT_APP_CBOR);
+	}
+	if (ret == 0) {
+		ret = coap_append_option_int(&response, COAP_OPTION_MAX_AGE, CONFIG_OPENP1_COAP_MAX_AGE_S);
+	}
+	if (ret == 0) {
+		ret = coap_packet_append_payload_marker(&response);
+	}
+	if (ret == 0) {
+		ret = coap_packet_append_payload(&response, payload, len);
+	}
+	if (ret < 0) {
+		return ret;
+	}
+	return send_packet(&response, addr, addr_len);
+}
+
+static bool same_client(const struct sockaddr *a, const struct sockaddr *b) {
+	const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) a;
+	const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *) b;
+
+	return a6->sin6_port == b6->sin6_port &&
+	       memcmp(&a6->sin6_addr, &b6->sin6_addr, sizeof(a6->sin6_addr)) == 0;
+}
+
+static struct coap_observer *find_observer(struct coap_resource *resource, const struct sockaddr *addr) {
+	struct coap_observer *observer;
+
+	SYS_SLIST_FOR_EACH_CONTAINER(&resource->observers, observer, list) {
+		if (same_client(&observer->addr, addr)) {
+			return observer;
+		}
+	}
+	return NULL;
+}
+
+static struct observer_state *observer_state(struct coap_observer *observer) {
+	return &observer_states[observer - observers];
+}
+
+static void remove_observer(struct coap_resource *resource, struct coap_observer *observer) {
+	coap_remove_observer(resource, observer);
+	memset(observer, 0, sizeof(*observer)); // Unused again
+}
+
+// Registers or deregisters an observer, as asked by the Observe option.
+// Returns true if the client observes the resource.
+static bool update_observer(struct coap_resource *resource, struct coap_packet *request,
+			    struct sockaddr *addr) {
+	int observe = coap_get_option_int(request, COAP_OPTION_OBSERVE);
+	struct coap_observer *observer = find_observer(resource, addr);
+
+	if (observe == 1 && observer != NULL) {
+		remove_observer(resource, observer);
+		return false;
+	}
+	if (observe != 0) {
+		return false;
+	}
+	if (observer != NULL) {
+		// Registered again, possibly with a new token
+		coap_remove_observer(resource, observer);
+	} else {
+		observer = coap_observer_next_unused(observers, MAX_OBSERVERS);
+		if (observer == NULL) {
+			LOG_WRN("Too many observers");
+			return false;
+		}
+	}
+	coap_observer_init(observer, request, addr);
+	coap_register_observer(resource, observer);
+	memset(observer_state(observer), 0, sizeof(struct observer_state));
+	return true;
+}
+
+static int get_handler(struct coap_resource *resource, struct coap_packet *request,
+		       struct sockaddr *addr, socklen_t addr_len) {
+	uint8_t token[COAP_TOKEN_MAX_LEN];
+	uint8_t tkl = coap_header_get_token(request, token);
+	uint16_t id = coap_header_get_id(request);
+	uint8_t type = coap_header_get_type(request);
+	bool observe = update_observer(resource, request, addr);
+
+	if (type == COAP_TYPE_CON) {
+		type = COAP_TYPE_ACK;
+	} else {
+		type = COAP_TYPE_NON_CON;
+		id = coap_next_id();
+	}
+	return send_representation(resource, addr, addr_len, type, id, token, tkl, observe);
+}
+
+// Notifications are non-confirmable, a lost one is repaired by the next. Every
+// CONFIG_OPENP1_COAP_CON_INTERVAL-th is confirmable, to learn whether the
+// observer is still there. Until it is acknowledged the following ones are
+// confirmable too, and stand in for its retransmissions (RFC 7641 4.5.2).
+static void notify_handler(struct coap_resource *resource, struct coap_observer *observer) {
+	struct observer_state *state = observer_state(observer);
+	uint8_t type = COAP_TYPE_NON_CON;
+	uint16_t id = coap_next_id();
+
+	if (state->unacked > 0 || ++state->notifications >= CONFIG_OPENP1_COAP_CON_INTERVAL) {
+		type = COAP_TYPE_CON;
+		state->notifications = 0;
+		state->con_id = id;
+		state->unacked++;
+	}
+	send_representation(resource, &observer->addr, sizeof(observer->addr), type, id,
+			    observer->token, observer->tkl, true);
+}
+
+static int well_known_core_handler(struct coap_resource *resource, struct coap_packet *request,
+				   struct sockaddr *addr, socklen_t addr_len) {
+	struct coap_packet response;
+	int ret = coap_well_known_core_get(resource, request, &response, tx_buf, sizeof(tx_buf));
+	if (ret < 0) {
+		return ret;
+	}
+	return send_packet(&response, addr, addr_len);
+}
+
+static int send_not_found(struct coap_packet *request, const struct sockaddr *addr, socklen_t addr_len) {
+	struct coap_packet response;
+	uint8_t token[COAP_TOKEN_MAX_LEN];
+	uint8_t tkl = coap_header_get_token(request, token);
+
+	if (coap_header_get_type(request) != COAP_TYPE_CON) {
+		return 0;
+	}
+	int ret = coap_packet_init(&response, tx_buf, sizeof(tx_buf), COAP_VERSION_1, COAP_TYPE_ACK, tkl, token,
+				   COAP_RESPONSE_CODE_NOT_FOUND, coap_header_get_id(request));
+	if (ret < 0) {
+		return ret;
+	}
+	return send_packet(&response, addr, addr_len);
+}
+
+// Resources are looked up until the first without a path, so only numeric
+// items get an entry. The meter time is part of the snapshot.
+static void init_resources(void) {
+	struct coap_resource *resource = resources;
+
+	for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+		if (data_definition_table[i].format == DATE_TIME_STRING) {
+			continue;
+		}
+		snprintk(item_numbers[i], NUMBER_LEN, "%d", i);
+		item_paths[i][0] = "items";
+		item_paths[i][1] = item_numbers[i];
+		item_paths[i][2] = NULL;
+		resource->get = get_handler;
+		resource->notify = notify_handler;
+		resource->path = item_paths[i];
+		resource->user_data = (void *) (uintptr_t) i;
+		item_resources[i] = resource++;
+	}
+	resource->get = get_handler;
+	resource->notify = notify_handler;
+	resource->path = snapshot_path;
+	resource->user_data = SNAPSHOT;
+	snapshot_resource = resource++;
+	resource->get = well_known_core_handler;
+	resource->path = well_known_path;
+}
+
+// A notification was rejected, the client is gone
+static void handle_reset(struct sockaddr *addr) {
+	for (struct coap_resource *resource = resources ; resource->path != NULL ; resource++) {
+		struct coap_observer *observer = find_observer(resource, addr);
+		if (observer != NULL) {
+			remove_observer(resource, observer);
+		}
+	}
+}
+
+// A confirmable notification was acknowledged, the client still observes
+static void handle_ack(const struct sockaddr *addr, uint16_t id) {
+	for (int i = 0 ; i < MAX_OBSERVERS ; i++) {
+		struct observer_state *state = &observer_states[i];
+		if (state->unacked > 0 && state->con_id == id && same_client(&observers[i].addr, addr)) {
+			state->unacked = 0;
+		}
+	}
+}
+
+// Drops observers that acknowledged none of their last confirmable
+// notifications, freeing their slots (RFC 7641 4.5)
+static void drop_unresponsive_observers(void) {
+	for (struct coap_resource *resource = resources ; resource->path != NULL ; resource++) {
+		struct coap_observer *observer, *next;
+
+		SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&resource->observers, observer, next, list) {
+			if (observer_state(observer)->unacked >= MAX_UNACKED) {
+				LOG_INF("Dropping observer, notifications not acknowledged");
+				remove_observer(resource, observer);
+			}
+		}
+	}
+}
+
+static void coap_server_task(void *p1, void *p2, void *p3) {
+	struct coap_packet request;
+	struct coap_option options[MAX_OPTIONS];
+	struct sockaddr_in6 client_addr;
+	socklen_t client_addr_len;
+
+	LOG_INF("Waiting for CoAP requests on port %d...", COAP_PORT);
+	while (true) {
+		client_addr_len = sizeof(client_addr);
+		int received = recvfrom(sock, rx_buf, sizeof(rx_buf), 0,
+					(struct sockaddr *) &client_addr, &client_addr_len);
+		if (received < 0) {
+			LOG_ERR("CoAP: Connection error %d", errno);
+			break;
+		}
+
+		int ret = coap_packet_parse(&request, rx_buf, received, options, MAX_OPTIONS);
+		if (ret < 0) {
+			LOG_WRN("Invalid CoAP packet: %d", ret);
+			continue;
+		}
+
+		k_mutex_lock(&coap_lock, K_FOREVER);
+		if (coap_header_get_type(&request) == COAP_TYPE_RESET) {
+			handle_reset((struct sockaddr *) &client_addr);
+		} else if (coap_header_get_type(&request) == COAP_TYPE_ACK) {
+			handle_ack((struct sockaddr *) &client_addr, coap_header_get_id(&request));
+		} else {
+			ret = coap_handle_request(&request, resources, options, MAX_OPTIONS,
+						  (struct sockaddr *) &client_addr, client_addr_len);
+			if (ret == -ENOENT) {
+				send_not_found(&request, (struct sockaddr *) &client_addr, client_addr_len);
+			} else if (ret < 0) {
+				LOG_DBG("Request not handled: %d", ret);
+			}
+		}
+		k_mutex_unlock(&coap_lock);
+	}
+}
+
+K_THREAD_DEFINE(coap_thread_id, STACK_SIZE,
+    coap_server_task, NULL, NULL, NULL,
+    RECEIVE_THREAD_PRIORITY, 0, -1);
+
+int coap_server_init(struct value_store *store) {
+	struct sockaddr_in6 addr;
+
+	value_store = store;
+	push_init(&notify_state);
+	init_resources();
+
+	(void)memset(&addr, 0, sizeof(addr));
+	addr.sin6_family = AF_INET6;
+	addr.sin6_port = htons(COAP_PORT);
+
+	sock = socket(addr.sin6_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		LOG_ERR("Failed to create CoAP socket: %d", errno);
+		return -errno;
+	}
+	if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		LOG_ERR("Failed to bind CoAP socket: %d", errno);
+		return -errno;
+	}
+
+	k_thread_name_set(coap_thread_id, "coap");
+	k_thread_start(coap_thread_id);
+
+	LOG_INF("CoAP server initialized");
+	return 0;
+}
+
+// Called from the publish queue after telegrams
+void coap_telegram_applied(struct value_store *store) {
+	if (sock < 0) {
+		return;
+	}
+
+	value_store_lock(store);
+	int changed = push_collect(&notify_state, &notify_config, store, k_uptime_get());
+	uint64_t pending = notify_state.pending;
+	push_commit(&notify_state, store);
+	value_store_unlock(store);
+	if (changed == 0) {
+		return;
+	}
+
+	k_mutex_lock(&coap_lock, K_FOREVER);
+	drop_unresponsive_observers();
+	for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+		if ((pending & BIT64(i)) && item_resources[i] != NULL) {
+			coap_resource_notify(item_resources[i]);
+		}
+	}
+	coap_resource_notify(snapshot_resource);
+	k_mutex_unlock(&coap_lock);
+}
+
+#else
+
+int coap_server_init(struct value_store *store) {
+	return 0;
+}
+
+void coap_telegram_applied(struct value_store *store) {}
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef COAP_SERVER_HEADER_H
+#define COAP_SERVER_HEADER_H
+
+#include "lib/value_store.h"
+
+int coap_server_init(struct value_store *store);
+// Notifies observers of the items changed beyond the deadband
+void coap_telegram_applied(struct value_store *store);
+
+#endif /* COAP_SERVER_HEADER_H */
@@ -7,10 +7,10 @@
 #include "lib/openp1.h"
 #include "line_log.h"
 #include "lib/telegram_framer.h"
+#include "lib/stats.h"
+#include "raw_telegram.h"
 
 #define READ_TIMEOUT_MS 200
-#define MAX_TELEGRAM_SIZE 8192
-#define TELEGRAM_BUF_POOL_SIZE 4
 
 LOG_MODULE_REGISTER(framer_task, LOG_LEVEL_DBG);
 
@@ -55,12 +55,15 @@ void framer_task(void *user_data) {
                 return;
             }
             LOG_DBG("Discarding frame due to timeout");
+            stats_increment(STAT_FRAMES_INCOMPLETE);
             telegram_framer_reset(telegram_framer);
             line_log_reset(line_log);
         } else {
             line_log_push(line_log, c);
             struct net_buf *frame = telegram_framer_push(telegram_framer, c);
             if (frame != NULL) {
+                stats_increment(STAT_FRAMES);
+                raw_telegram_publish(frame);
                 net_buf_put(framed_telegram_queue, frame);
             }
 	    }
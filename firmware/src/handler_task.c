@@ -19,25 +19,18 @@ LOG_MODULE_REGISTER(handler_task, LOG_LEVEL_DBG);
 K_SEM_DEFINE(handler_task_start, 0, 1);
 
 static struct k_msgq *telegram_queue = NULL;
-static update_value_store_fun update_value_store;
+static apply_telegram_fun apply_telegram;
 
-int handler_task_init(struct k_msgq *input, update_value_store_fun update_fun) {
+int handler_task_init(struct k_msgq *input, apply_telegram_fun apply_fun) {
     telegram_queue = input;
-    update_value_store = update_fun;
+    apply_telegram = apply_fun;
     k_sem_give(&handler_task_start);
     return 0;
 }
 
 void handle_telegram(struct telegram *telegram) {
-    int count = 0;
-    struct data_item *data_item;
-    struct telegram_data_iterator iter;
-    telegram_item_iterator_init(telegram, &iter);
-    while (NULL != (data_item = telegram_item_iterator_next(&iter))) {
-        update_value_store(data_item);
-        count++;
-    }
-    LOG_DBG("Value store updated with %d values.", count);
+    apply_telegram(telegram);
+    LOG_DBG("Value store updated with %d values.", telegram_items_count(telegram));
 }
 
 void handler_task(void *, void *, void *) {
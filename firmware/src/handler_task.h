@@ -4,8 +4,8 @@
 #include <zephyr/kernel.h>
 #include "lib/telegram.h"
 
-typedef void (*update_value_store_fun)(struct data_item *);
+typedef void (*apply_telegram_fun)(struct telegram *);
 
-int handler_task_init(struct k_msgq *input, update_value_store_fun update_fun);
+int handler_task_init(struct k_msgq *input, apply_telegram_fun apply_fun);
 
 #endif /* PARSER_TASK_HEADER_H */
\ No newline at end of file
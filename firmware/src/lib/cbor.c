@@ -0,0 +1,147 @@
+#include "cbor.h"
+
+#include <zephyr/kernel.h>
+#include <string.h>
+
+#define MAJOR_UINT 0
+#define MAJOR_NEGATIVE 1
+#define MAJOR_TEXT 3
+#define MAJOR_ARRAY 4
+#define MAJOR_MAP 5
+#define SIMPLE_NULL 0xf6
+
+void cbor_writer_init(struct cbor_writer *writer, uint8_t *buf, size_t size) {
+    writer->buf = buf;
+    writer->size = size;
+    writer->len = 0;
+    writer->overflow = false;
+}
+
+static void put_bytes(struct cbor_writer *writer, const uint8_t *bytes, size_t len) {
+    if (writer->overflow || writer->len + len > writer->size) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(&writer->buf[writer->len], bytes, len);
+    writer->len += len;
+}
+
+// Initial byte and argument in the shortest form
+static void put_head(struct cbor_writer *writer, uint8_t major, uint64_t value) {
+    uint8_t head[9];
+    size_t len;
+
+    if (value < 24) {
+        head[0] = major << 5 | value;
+        len = 1;
+    } else if (value <= UINT8_MAX) {
+        head[0] = major << 5 | 24;
+        len = 2;
+    } else if (value <= UINT16_MAX) {
+        head[0] = major << 5 | 25;
+        len = 3;
+    } else if (value <= UINT32_MAX) {
+        head[0] = major << 5 | 26;
+        len = 5;
+    } else {
+        head[0] = major << 5 | 27;
+        len = 9;
+    }
+    for (size_t i = len - 1 ; i > 0 ; i--) {
+        head[i] = value & 0xff;
+        value >>= 8;
+    }
+    put_bytes(writer, head, len);
+}
+
+void cbor_put_uint(struct cbor_writer *writer, uint64_t value) {
+    put_head(writer, MAJOR_UINT, value);
+}
+
+void cbor_put_int(struct cbor_writer *writer, int64_t value) {
+    if (value < 0) {
+        put_head(writer, MAJOR_NEGATIVE, -1 - value);
+    } else {
+        put_head(writer, MAJOR_UINT, value);
+    }
+}
+
+void cbor_put_text(struct cbor_writer *writer, const char *text, size_t len) {
+    put_head(writer, MAJOR_TEXT, len);
+    put_bytes(writer, (const uint8_t *) text, len);
+}
+
+void cbor_put_array(struct cbor_writer *writer, size_t count) {
+    put_head(writer, MAJOR_ARRAY, count);
+}
+
+void cbor_put_map(struct cbor_writer *writer, size_t count) {
+    put_head(writer, MAJOR_MAP, count);
+}
+
+void cbor_put_null(struct cbor_writer *writer) {
+    uint8_t null = SIMPLE_NULL;
+    put_bytes(writer, &null, 1);
+}
+
+int cbor_writer_finish(struct cbor_writer *writer) {
+    return writer->overflow ? -ENOMEM : writer->len;
+}
+
+static bool item_value(struct value_store *store, enum Item item, int64_t *value) {
+    return value_store_is_fresh(store, item) &&
+           data_item_numeric_value(&store->rows[item].data, value) == 0;
+}
+
+int cbor_encode_item(struct value_store *store, enum Item item, uint8_t *buf, size_t size) {
+    struct cbor_writer writer;
+    int64_t value;
+
+    if (item >= _ITEM_COUNT || data_definition_table[item].format == DATE_TIME_STRING) {
+        return -EINVAL;
+    }
+    cbor_writer_init(&writer, buf, size);
+    cbor_put_map(&writer, 2);
+    cbor_put_text(&writer, "v", 1);
+    if (item_value(store, item, &value)) {
+        cbor_put_int(&writer, value);
+    } else {
+        cbor_put_null(&writer);
+    }
+    cbor_put_text(&writer, "e", 1);
+    cbor_put_int(&writer, -data_format_decimals(data_definition_table[item].format));
+    return cbor_writer_finish(&writer);
+}
+
+int cbor_encode_snapshot(struct value_store *store, uint8_t *buf, size_t size) {
+    struct cbor_writer writer;
+    int64_t value;
+    int count = 0;
+    bool has_time = value_store_is_fresh(store, DATE_TIME);
+
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (item_value(store, i, &value)) {
+            count++;
+        }
+    }
+
+    cbor_writer_init(&writer, buf, size);
+    cbor_put_map(&writer, has_time ? 3 : 2);
+    cbor_put_text(&writer, "g", 1);
+    cbor_put_uint(&writer, store->generation);
+    if (has_time) {
+        const uint8_t *date_time = store->rows[DATE_TIME].data.value.date_time;
+        cbor_put_text(&writer, "t", 1);
+        cbor_put_text(&writer, (const char *) date_time,
+                      strnlen((const char *) date_time, sizeof(store->rows[DATE_TIME].data.value.date_time)));
+    }
+    cbor_put_text(&writer, "v", 1);
+    cbor_put_map(&writer, count);
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (item_value(store, i, &value)) {
+            cbor_put_uint(&writer, i);
+            cbor_put_int(&writer, value);
+        }
+    }
+    return cbor_writer_finish(&writer);
+}
@@ -0,0 +1,33 @@
+#ifndef CBOR_HEADER_H
+#define CBOR_HEADER_H
+
+#include "value_store.h"
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+// Minimal CBOR (RFC 8949) writer for definite length maps, arrays, integers
+// and text. Writes past the end of the buffer are dropped and flagged.
+struct cbor_writer {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+};
+
+void cbor_writer_init(struct cbor_writer *writer, uint8_t *buf, size_t size);
+void cbor_put_uint(struct cbor_writer *writer, uint64_t value);
+void cbor_put_int(struct cbor_writer *writer, int64_t value);
+void cbor_put_text(struct cbor_writer *writer, const char *text, size_t len);
+void cbor_put_array(struct cbor_writer *writer, size_t count);
+void cbor_put_map(struct cbor_writer *writer, size_t count);
+void cbor_put_null(struct cbor_writer *writer);
+// Returns the encoded length, or -ENOMEM if the buffer was too small
+int cbor_writer_finish(struct cbor_writer *writer);
+
+// One item as {"v": value or null if stale, "e": decimal exponent}
+int cbor_encode_item(struct value_store *store, enum Item item, uint8_t *buf, size_t size);
+// All fresh items as {"g": generation, "t": meter time, "v": {item number: value}}
+int cbor_encode_snapshot(struct value_store *store, uint8_t *buf, size_t size);
+
+#endif /* CBOR_HEADER_H */
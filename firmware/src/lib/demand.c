@@ -0,0 +1,101 @@
+#include "demand.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(demand, LOG_LEVEL_DBG);
+
+#define SECONDS_PER_HOUR 3600
+
+void demand_init(struct demand_tracker *tracker) {
+    tracker->started = false;
+    tracker->peak_valid = false;
+    tracker->month_peak = 0;
+}
+
+static int parse_two_digits(const uint8_t *s, int min, int max) {
+    if (s[0] < '0' || s[0] > '9' || s[1] < '0' || s[1] > '9') {
+        return -1;
+    }
+    int value = (s[0] - '0') * 10 + (s[1] - '0');
+    return (value < min || value > max) ? -1 : value;
+}
+
+// Parses the meter clock, YYMMDDhhmmssX, into a month and the seconds into it
+int demand_parse_date_time(const uint8_t *date_time, uint16_t *month, uint32_t *second_of_month) {
+    int year = parse_two_digits(&date_time[0], 0, 99);
+    int mon = parse_two_digits(&date_time[2], 1, 12);
+    int day = parse_two_digits(&date_time[4], 1, 31);
+    int hour = parse_two_digits(&date_time[6], 0, 23);
+    int min = parse_two_digits(&date_time[8], 0, 59);
+    int sec = parse_two_digits(&date_time[10], 0, 59);
+    if (year < 0 || mon < 0 || day < 0 || hour < 0 || min < 0 || sec < 0) {
+        return -EINVAL;
+    }
+    *month = year * 12 + mon - 1;
+    *second_of_month = ((day - 1) * 24 + hour) * SECONDS_PER_HOUR + min * 60 + sec;
+    return 0;
+}
+
+static uint32_t average_power(uint32_t energy, uint32_t seconds) {
+    return seconds == 0 ? 0 : (uint64_t) energy * SECONDS_PER_HOUR / seconds;
+}
+
+static void start_interval(struct demand_tracker *tracker, uint16_t month, uint32_t slot,
+                           uint32_t second, uint32_t energy, bool complete) {
+    if (tracker->month != month || !tracker->started) {
+        tracker->peak_valid = false;
+        tracker->month_peak = 0;
+    }
+    tracker->started = true;
+    tracker->complete = complete;
+    tracker->month = month;
+    tracker->slot = slot;
+    tracker->start_s = second;
+    tracker->start_energy = energy;
+}
+
+// Feeds one telegram. power is the current import in W, or negative if unknown.
+int demand_update(struct demand_tracker *tracker, const uint8_t *date_time, uint32_t energy,
+                  int32_t power, struct demand_result *result) {
+    uint16_t month;
+    uint32_t second;
+    if (demand_parse_date_time(date_time, &month, &second) < 0) {
+        LOG_WRN("Invalid meter time");
+        return -EINVAL;
+    }
+    uint32_t slot = second / DEMAND_INTERVAL_S;
+
+    if (!tracker->started || energy < tracker->last_energy ||
+        (month == tracker->month && second < tracker->last_s)) {
+        start_interval(tracker, month, slot, second, energy, false);
+    } else if (month != tracker->month || slot != tracker->slot) {
+        bool next_slot = (month == tracker->month && slot == tracker->slot + 1) ||
+                         (month == tracker->month + 1 && slot == 0);
+        if (tracker->complete && next_slot) {
+            // Energy at the first sample of the next interval closes this one
+            uint32_t peak = average_power(energy - tracker->start_energy, DEMAND_INTERVAL_S);
+            if (!tracker->peak_valid || peak > tracker->month_peak) {
+                tracker->month_peak = peak;
+                tracker->peak_valid = true;
+            }
+            LOG_INF("Quarter-hour demand: %u W", peak);
+        }
+        // A gap or clock jump leaves the new interval partial
+        start_interval(tracker, month, slot, second, energy, next_slot);
+    }
+    tracker->last_s = second;
+    tracker->last_energy = energy;
+
+    uint32_t consumed = energy - tracker->start_energy;
+    uint32_t elapsed = second - tracker->start_s;
+    uint32_t remaining = (slot + 1) * DEMAND_INTERVAL_S - second;
+    uint32_t rate = power >= 0 ? (uint32_t) power : average_power(consumed, elapsed);
+
+    result->average = average_power(consumed, elapsed);
+    result->projected = average_power(consumed + (uint64_t) rate * remaining / SECONDS_PER_HOUR,
+                                      elapsed + remaining);
+    result->peak_valid = tracker->peak_valid;
+    result->month_peak = tracker->month_peak;
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef DEMAND_HEADER_H
+#define DEMAND_HEADER_H
+
+#include <zephyr/types.h>
+
+#define DEMAND_INTERVAL_S (15 * 60)
+
+// Quarter-hour demand, in W, from the meter energy counter (Wh) aligned to
+// the meter clock. An interval only counts towards the monthly peak if it
+// was observed from its start.
+struct demand_tracker {
+    bool started;
+    bool complete;       // Current interval was observed from its start
+    uint16_t month;      // Year * 12 + month of the current interval
+    uint32_t slot;       // Interval number within the month
+    uint32_t start_s;    // Seconds into the month of the first sample in the interval
+    uint32_t start_energy;
+    uint32_t last_s;
+    uint32_t last_energy;
+    bool peak_valid;
+    uint32_t month_peak;
+};
+
+struct demand_result {
+    uint32_t average;   // Average over the elapsed part of the current interval
+    uint32_t projected; // Expected average at the end of the current interval
+    bool peak_valid;
+    uint32_t month_peak;
+};
+
+void demand_init(struct demand_tracker *tracker);
+int demand_parse_date_time(const uint8_t *date_time, uint16_t *month, uint32_t *second_of_month);
+int demand_update(struct demand_tracker *tracker, const uint8_t *date_time, uint32_t energy,
+                  int32_t power, struct demand_result *result);
+
+#endif /* DEMAND_HEADER_H */
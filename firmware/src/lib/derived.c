@@ -0,0 +1,156 @@
+#include "derived.h"
+#include "openp1.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(derived, LOG_LEVEL_DBG);
+
+#define EWMA_FRACTION_BITS 8
+
+void sliding_window_init(struct sliding_window *window) {
+    window->head = 0;
+    window->tail = 0;
+    window->sum = 0;
+    window->min_front = 0;
+    window->min_len = 0;
+    window->max_front = 0;
+    window->max_len = 0;
+}
+
+#define SLOT(seq) ((seq) % DERIVED_WINDOW_SAMPLES)
+#define QUEUE_AT(front, i) (((front) + (i)) % DERIVED_WINDOW_SAMPLES)
+
+static void evict_oldest(struct sliding_window *window) {
+    uint32_t seq = window->tail++;
+    window->sum -= window->value[SLOT(seq)];
+    if (window->min_len > 0 && window->min_queue[window->min_front] == seq) {
+        window->min_front = QUEUE_AT(window->min_front, 1);
+        window->min_len--;
+    }
+    if (window->max_len > 0 && window->max_queue[window->max_front] == seq) {
+        window->max_front = QUEUE_AT(window->max_front, 1);
+        window->max_len--;
+    }
+}
+
+// Amortized O(1): every sample enters and leaves each queue at most once
+void sliding_window_push(struct sliding_window *window, uint32_t timestamp, int32_t value) {
+    while (window->head != window->tail &&
+           (window->head - window->tail >= DERIVED_WINDOW_SAMPLES ||
+            timestamp - window->timestamp[SLOT(window->tail)] >= DERIVED_WINDOW_MS)) {
+        evict_oldest(window);
+    }
+
+    uint32_t seq = window->head++;
+    window->timestamp[SLOT(seq)] = timestamp;
+    window->value[SLOT(seq)] = value;
+    window->sum += value;
+
+    while (window->min_len > 0 &&
+           window->value[SLOT(window->min_queue[QUEUE_AT(window->min_front, window->min_len - 1)])] >= value) {
+        window->min_len--;
+    }
+    window->min_queue[QUEUE_AT(window->min_front, window->min_len++)] = seq;
+
+    while (window->max_len > 0 &&
+           window->value[SLOT(window->max_queue[QUEUE_AT(window->max_front, window->max_len - 1)])] <= value) {
+        window->max_len--;
+    }
+    window->max_queue[QUEUE_AT(window->max_front, window->max_len++)] = seq;
+}
+
+int sliding_window_count(struct sliding_window *window) {
+    return window->head - window->tail;
+}
+
+// Timestamps are kept modulo 2^32, only their differences matter
+void sliding_window_rebase(struct sliding_window *window, int64_t delta) {
+    for (uint32_t seq = window->tail ; seq != window->head ; seq++) {
+        window->timestamp[SLOT(seq)] += (uint32_t) delta;
+    }
+}
+
+int32_t sliding_window_min(struct sliding_window *window) {
+    return window->value[SLOT(window->min_queue[window->min_front])];
+}
+
+int32_t sliding_window_max(struct sliding_window *window) {
+    return window->value[SLOT(window->max_queue[window->max_front])];
+}
+
+int32_t sliding_window_mean(struct sliding_window *window) {
+    int64_t count = sliding_window_count(window);
+    return (window->sum + count / 2) / count;
+}
+
+int derived_metrics_init(struct derived_metrics *metrics) {
+    int sources = 0;
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        metrics->slot[i] = -1;
+    }
+    for (int i = 0 ; i < DERIVED_MAX_SOURCES ; i++) {
+        metrics->aggregates[i].valid = false;
+        sliding_window_init(&metrics->aggregates[i].window);
+    }
+    for (int i = 0 ; i < derived_definition_count ; i++) {
+        const struct derived_definition *def = &derived_definition_table[i];
+        if (def->aggregate == AGGREGATE_NET || metrics->slot[def->source] >= 0) {
+            continue;
+        }
+        if (sources >= DERIVED_MAX_SOURCES) {
+            LOG_ERR("Too many derived sources, increase DERIVED_MAX_SOURCES");
+            return -ENOMEM;
+        }
+        metrics->slot[def->source] = sources++;
+    }
+    return 0;
+}
+
+void derived_metrics_rebase(struct derived_metrics *metrics, int64_t delta) {
+    for (int i = 0 ; i < DERIVED_MAX_SOURCES ; i++) {
+        sliding_window_rebase(&metrics->aggregates[i].window, delta);
+    }
+}
+
+void derived_metrics_push(struct derived_metrics *metrics, enum Item source, uint32_t timestamp, int64_t value) {
+    if (metrics->slot[source] < 0) {
+        return;
+    }
+    struct aggregate *aggregate = &metrics->aggregates[metrics->slot[source]];
+    int64_t fixed = value * (1 << EWMA_FRACTION_BITS);
+    if (!aggregate->valid) {
+        aggregate->ewma = fixed;
+        aggregate->valid = true;
+    } else {
+        aggregate->ewma += (fixed - aggregate->ewma) / (1 << DERIVED_EWMA_SHIFT);
+    }
+    sliding_window_push(&aggregate->window, timestamp, value);
+}
+
+// Current value of a windowed aggregate, AGGREGATE_NET is computed by the caller
+int derived_metrics_get(struct derived_metrics *metrics, const struct derived_definition *def, int64_t *value) {
+    if (def->aggregate == AGGREGATE_NET || metrics->slot[def->source] < 0) {
+        return -EINVAL;
+    }
+    struct aggregate *aggregate = &metrics->aggregates[metrics->slot[def->source]];
+    if (!aggregate->valid) {
+        return -ENODATA;
+    }
+    switch (def->aggregate) {
+        case AGGREGATE_EWMA:
+            *value = (aggregate->ewma + (1 << (EWMA_FRACTION_BITS - 1))) / (1 << EWMA_FRACTION_BITS);
+            return 0;
+        case AGGREGATE_MIN:
+            *value = sliding_window_min(&aggregate->window);
+            return 0;
+        case AGGREGATE_MAX:
+            *value = sliding_window_max(&aggregate->window);
+            return 0;
+        case AGGREGATE_MEAN:
+            *value = sliding_window_mean(&aggregate->window);
+            return 0;
+        default:
+            return -EINVAL;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef DERIVED_HEADER_H
+#define DERIVED_HEADER_H
+
+#include <zephyr/types.h>
+#include "openp1.h"
+
+// Sliding windows cover the last DERIVED_WINDOW_MS, limited to
+// DERIVED_WINDOW_SAMPLES telegrams.
+#ifdef CONFIG_OPENP1_DERIVED_WINDOW_MS
+#define DERIVED_WINDOW_MS CONFIG_OPENP1_DERIVED_WINDOW_MS
+#else
+#define DERIVED_WINDOW_MS (5 * 60 * 1000)
+#endif
+
+#ifdef CONFIG_OPENP1_DERIVED_WINDOW_SAMPLES
+#define DERIVED_WINDOW_SAMPLES CONFIG_OPENP1_DERIVED_WINDOW_SAMPLES
+#else
+#define DERIVED_WINDOW_SAMPLES 64
+#endif
+
+// EWMA weight of a new sample is 1 / 2^DERIVED_EWMA_SHIFT
+#ifdef CONFIG_OPENP1_DERIVED_EWMA_SHIFT
+#define DERIVED_EWMA_SHIFT CONFIG_OPENP1_DERIVED_EWMA_SHIFT
+#else
+#define DERIVED_EWMA_SHIFT 3
+#endif
+
+// Number of distinct source items in derived_definition_table
+#define DERIVED_MAX_SOURCES 4
+
+struct sliding_window {
+    uint32_t timestamp[DERIVED_WINDOW_SAMPLES];
+    int32_t value[DERIVED_WINDOW_SAMPLES];
+    uint32_t head; // Sequence number of the next sample
+    uint32_t tail; // Sequence number of the oldest sample
+    int64_t sum;
+    // Monotonic queues of sequence numbers, front is the current min/max
+    uint32_t min_queue[DERIVED_WINDOW_SAMPLES];
+    uint32_t max_queue[DERIVED_WINDOW_SAMPLES];
+    uint16_t min_front, min_len;
+    uint16_t max_front, max_len;
+};
+
+struct aggregate {
+    bool valid;
+    int64_t ewma; // Fixed point, 8 fractional bits
+    struct sliding_window window;
+};
+
+struct derived_metrics {
+    int8_t slot[_ITEM_COUNT];
+    struct aggregate aggregates[DERIVED_MAX_SOURCES];
+};
+
+void sliding_window_init(struct sliding_window *window);
+void sliding_window_push(struct sliding_window *window, uint32_t timestamp, int32_t value);
+int32_t sliding_window_min(struct sliding_window *window);
+int32_t sliding_window_max(struct sliding_window *window);
+int32_t sliding_window_mean(struct sliding_window *window);
+int sliding_window_count(struct sliding_window *window);
+void sliding_window_rebase(struct sliding_window *window, int64_t delta);
+
+int derived_metrics_init(struct derived_metrics *metrics);
+void derived_metrics_rebase(struct derived_metrics *metrics, int64_t delta);
+void derived_metrics_push(struct derived_metrics *metrics, enum Item source, uint32_t timestamp, int64_t value);
+int derived_metrics_get(struct derived_metrics *metrics, const struct derived_definition *def, int64_t *value);
+
+#endif /* DERIVED_HEADER_H */
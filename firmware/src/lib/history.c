@@ -0,0 +1,165 @@
+#include "history.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(history, LOG_LEVEL_DBG);
+
+int zigzag_varint_encode(int64_t value, uint8_t *buf) {
+    uint64_t zigzag = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+    int len = 0;
+    do {
+        uint8_t byte = zigzag & 0x7f;
+        zigzag >>= 7;
+        buf[len++] = byte | (zigzag ? 0x80 : 0);
+    } while (zigzag);
+    return len;
+}
+
+// Returns consumed bytes, or -1 if buf ends before the varint does
+int zigzag_varint_decode(const uint8_t *buf, int len, int64_t *value) {
+    uint64_t zigzag = 0;
+    for (int i = 0 ; i < len && i < 10 ; i++) {
+        zigzag |= (uint64_t) (buf[i] & 0x7f) << (7 * i);
+        if (!(buf[i] & 0x80)) {
+            *value = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+void history_init(struct history *history) {
+    history->head = 0;
+    history->tail = 0;
+    history->used = 0;
+    history->count = 0;
+}
+
+// Copies the bytes of the record at pos out of the ring, unwrapping it
+static void ring_peek(struct history *history, uint16_t pos, uint8_t *record, int len) {
+    for (int i = 0 ; i < len ; i++) {
+        record[i] = history->buf[(pos + i) % HISTORY_BUFFER_SIZE];
+    }
+}
+
+// Decodes the delta pair at pos and applies it to sample, returns record size
+static int decode_record(struct history *history, uint16_t pos, struct history_sample *sample) {
+    uint8_t record[HISTORY_MAX_RECORD_SIZE];
+    int64_t dt, dv;
+    int len = MIN(HISTORY_MAX_RECORD_SIZE, history->used - ((pos - history->tail + HISTORY_BUFFER_SIZE) % HISTORY_BUFFER_SIZE));
+    ring_peek(history, pos, record, len);
+
+    int dt_len = zigzag_varint_decode(record, len, &dt);
+    if (dt_len < 0) {
+        return -1;
+    }
+    int dv_len = zigzag_varint_decode(&record[dt_len], len - dt_len, &dv);
+    if (dv_len < 0) {
+        return -1;
+    }
+    sample->timestamp += dt;
+    sample->value += dv;
+    return dt_len + dv_len;
+}
+
+static void drop_oldest(struct history *history) {
+    if (history->count <= 1) {
+        history_init(history);
+        return;
+    }
+    int len = decode_record(history, history->tail, &history->first);
+    if (len < 0) {
+        LOG_ERR("BUG: Corrupt history ring, resetting");
+        history_init(history);
+        return;
+    }
+    history->tail = (history->tail + len) % HISTORY_BUFFER_SIZE;
+    history->used -= len;
+    history->count--;
+}
+
+void history_append(struct history *history, int64_t timestamp, int64_t value) {
+    struct history_sample sample = { timestamp, value };
+    if (history->count == 0) {
+        history->first = sample;
+        history->last = sample;
+        history->count = 1;
+        return;
+    }
+
+    uint8_t record[HISTORY_MAX_RECORD_SIZE];
+    int len = zigzag_varint_encode(timestamp - history->last.timestamp, record);
+    len += zigzag_varint_encode(value - history->last.value, &record[len]);
+
+    while (history->count >= HISTORY_DEPTH || HISTORY_BUFFER_SIZE - history->used < len) {
+        drop_oldest(history);
+    }
+    if (history->count == 0) {
+        // Everything was dropped, sample becomes the new base
+        history_append(history, timestamp, value);
+        return;
+    }
+
+    for (int i = 0 ; i < len ; i++) {
+        history->buf[(history->head + i) % HISTORY_BUFFER_SIZE] = record[i];
+    }
+    history->head = (history->head + len) % HISTORY_BUFFER_SIZE;
+    history->used += len;
+    history->count++;
+    history->last = sample;
+}
+
+void history_iterator_init(struct history *history, struct history_iterator *iter) {
+    iter->_history = history;
+    iter->_sample = history->first;
+    iter->_pos = history->tail;
+    iter->_index = 0;
+}
+
+// Returns the samples oldest first, NULL after the newest
+struct history_sample * history_iterator_next(struct history_iterator *iter) {
+    struct history *history = iter->_history;
+    if (iter->_index >= history->count) {
+        return NULL;
+    }
+    if (iter->_index > 0) {
+        int len = decode_record(history, iter->_pos, &iter->_sample);
+        if (len < 0) {
+            LOG_ERR("BUG: Corrupt history ring");
+            return NULL;
+        }
+        iter->_pos = (iter->_pos + len) % HISTORY_BUFFER_SIZE;
+    }
+    iter->_index++;
+    return &iter->_sample;
+}
+
+// Copies up to max samples newer than since into out, oldest first
+int history_read(struct history *history, int64_t since, struct history_sample *out, int max) {
+    if (history->count == 0 || history->last.timestamp <= since) {
+        return 0;
+    }
+
+    struct history_iterator iter;
+    struct history_sample *sample;
+    int n = 0;
+
+    history_iterator_init(history, &iter);
+    while (n < max && NULL != (sample = history_iterator_next(&iter))) {
+        if (sample->timestamp > since) {
+            out[n++] = *sample;
+        }
+    }
+    return n;
+}
+
+int history_count(struct history *history) {
+    return history->count;
+}
+
+// Shifts all timestamps by delta, samples are stored relative to each other
+void history_rebase(struct history *history, int64_t delta) {
+    history->first.timestamp += delta;
+    history->last.timestamp += delta;
+}
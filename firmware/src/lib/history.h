@@ -0,0 +1,58 @@
+#ifndef HISTORY_HEADER_H
+#define HISTORY_HEADER_H
+
+#include <zephyr/types.h>
+
+// Samples are kept as zigzag varint encoded (time, value) deltas against the
+// previous sample, so a ring holds up to HISTORY_DEPTH samples or as many as
+// fit in HISTORY_BUFFER_SIZE bytes, whichever is reached first.
+#ifdef CONFIG_OPENP1_HISTORY_DEPTH
+#define HISTORY_DEPTH CONFIG_OPENP1_HISTORY_DEPTH
+#else
+#define HISTORY_DEPTH 64
+#endif
+
+#ifdef CONFIG_OPENP1_HISTORY_BUFFER_SIZE
+#define HISTORY_BUFFER_SIZE CONFIG_OPENP1_HISTORY_BUFFER_SIZE
+#else
+#define HISTORY_BUFFER_SIZE 256
+#endif
+
+// Worst case size of one encoded delta pair
+#define HISTORY_MAX_RECORD_SIZE 20
+
+struct history_sample {
+    int64_t timestamp;
+    int64_t value;
+};
+
+struct history {
+    uint8_t buf[HISTORY_BUFFER_SIZE];
+    uint16_t head;  // Write position of next record
+    uint16_t tail;  // Position of the record following the oldest sample
+    uint16_t used;  // Encoded bytes in buf
+    uint16_t count; // Samples, including the oldest one kept in first
+    struct history_sample first;
+    struct history_sample last;
+};
+
+struct history_iterator {
+    struct history *_history;
+    struct history_sample _sample;
+    uint16_t _pos;
+    uint16_t _index;
+};
+
+void history_init(struct history *history);
+void history_append(struct history *history, int64_t timestamp, int64_t value);
+int history_read(struct history *history, int64_t since, struct history_sample *out, int max);
+int history_count(struct history *history);
+void history_rebase(struct history *history, int64_t delta);
+
+void history_iterator_init(struct history *history, struct history_iterator *iter);
+struct history_sample * history_iterator_next(struct history_iterator *iter);
+
+int zigzag_varint_encode(int64_t value, uint8_t *buf);
+int zigzag_varint_decode(const uint8_t *buf, int len, int64_t *value);
+
+#endif /* HISTORY_HEADER_H */
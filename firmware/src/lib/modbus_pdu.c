@@ -0,0 +1,165 @@
+#include "modbus_pdu.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(modbus_pdu, LOG_LEVEL_DBG);
+
+#define MODBUS_EXCEPTION_FLAG 0x80
+// Unit id addressing the server itself over Modbus TCP
+#define MODBUS_TCP_UNIT_ID 0xff
+
+// Returns the full ADU length announced by the header, or -EINVAL
+int modbus_mbap_parse(const uint8_t *buf, size_t len, struct modbus_mbap *mbap) {
+    if (len < MODBUS_MBAP_LENGTH) {
+        return -EINVAL;
+    }
+    mbap->trans_id = sys_get_be16(&buf[0]);
+    mbap->proto_id = sys_get_be16(&buf[2]);
+    mbap->length = sys_get_be16(&buf[4]);
+    mbap->unit_id = buf[6];
+    if (mbap->length < 2 || mbap->length > MODBUS_MAX_PDU_LENGTH + 1) {
+        return -EINVAL;
+    }
+    return MODBUS_MBAP_LENGTH - 1 + mbap->length;
+}
+
+void modbus_mbap_put(const struct modbus_mbap *mbap, uint8_t *buf) {
+    sys_put_be16(mbap->trans_id, &buf[0]);
+    sys_put_be16(mbap->proto_id, &buf[2]);
+    sys_put_be16(mbap->length, &buf[4]);
+    buf[6] = mbap->unit_id;
+}
+
+uint16_t modbus_read_registers_fitting(uint16_t budget) {
+    if (budget < MODBUS_READ_RESPONSE_OVERHEAD + 2) {
+        return 0;
+    }
+    return MIN((budget - MODBUS_READ_RESPONSE_OVERHEAD) / 2, MODBUS_MAX_READ_REGISTERS);
+}
+
+// Common FC03/FC04 handling: validates the request and lets reader fill the response
+int modbus_pdu_read_registers(const uint8_t *req, uint16_t req_len, uint8_t *resp, uint16_t resp_size,
+                              modbus_register_reader_t reader, void *ctx) {
+    if (req_len != 5) {
+        return -MODBUS_EXC_ILLEGAL_DATA_VALUE;
+    }
+    uint16_t addr = sys_get_be16(&req[1]);
+    uint16_t count = sys_get_be16(&req[3]);
+
+    if (count == 0 || count > MODBUS_MAX_READ_REGISTERS) {
+        return -MODBUS_EXC_ILLEGAL_DATA_VALUE;
+    }
+    if (addr + count > 0x10000) {
+        return -MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+    }
+    uint16_t len = 2 + count * 2;
+    if (len > resp_size) {
+        LOG_WRN("Response too large");
+        return -MODBUS_EXC_SERVER_DEVICE_FAILURE;
+    }
+
+    int exc = reader(ctx, addr, count, &resp[2]);
+    if (exc != 0) {
+        return -exc;
+    }
+    resp[0] = req[0];
+    resp[1] = count * 2;
+    return len;
+}
+
+// Parses a long poll request PDU. Returns 0 or a negated MODBUS_EXC_* code.
+int modbus_long_poll_parse(const uint8_t *req, uint16_t req_len, struct modbus_long_poll *poll) {
+    if (req_len != MODBUS_LONG_POLL_REQUEST_LENGTH) {
+        return -MODBUS_EXC_ILLEGAL_DATA_VALUE;
+    }
+    poll->addr = sys_get_be16(&req[1]);
+    poll->count = sys_get_be16(&req[3]);
+    poll->generation = sys_get_be32(&req[5]);
+    poll->timeout_s = sys_get_be16(&req[9]);
+
+    if (poll->count == 0 || poll->count > MODBUS_LONG_POLL_MAX_REGISTERS) {
+        return -MODBUS_EXC_ILLEGAL_DATA_VALUE;
+    }
+    if (poll->addr + poll->count > 0x10000) {
+        return -MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+    }
+    return 0;
+}
+
+// Answers a long poll with the registers and the current generation, or defers it
+// while the client has already seen the current generation
+int modbus_pdu_long_poll(const uint8_t *req, uint16_t req_len, uint8_t *resp, uint16_t resp_size,
+                         uint32_t generation, bool may_defer, modbus_register_reader_t reader, void *ctx) {
+    struct modbus_long_poll poll;
+    int ret = modbus_long_poll_parse(req, req_len, &poll);
+    if (ret < 0) {
+        return ret;
+    }
+    if (may_defer && poll.timeout_s > 0 && poll.generation == generation) {
+        return MODBUS_PDU_DEFERRED;
+    }
+
+    uint16_t len = 6 + poll.count * 2;
+    if (len > resp_size) {
+        LOG_WRN("Response too large");
+        return -MODBUS_EXC_SERVER_DEVICE_FAILURE;
+    }
+    int exc = reader(ctx, poll.addr, poll.count, &resp[6]);
+    if (exc != 0) {
+        return -exc;
+    }
+    resp[0] = req[0];
+    resp[1] = 4 + poll.count * 2;
+    sys_put_be32(generation, &resp[2]);
+    return len;
+}
+
+// Decodes a Modbus TCP ADU from req and encodes the reply straight into resp.
+// Returns the response ADU length, 0 if the request is to be dropped, or -EINVAL.
+int modbus_pdu_process(const struct modbus_pdu_engine *engine, void *ctx,
+                       const uint8_t *req, size_t req_len, uint8_t *resp, size_t resp_size) {
+    struct modbus_mbap mbap;
+    int adu_len = modbus_mbap_parse(req, req_len, &mbap);
+    if (adu_len < 0 || adu_len > req_len) {
+        LOG_WRN("Received incomplete ADU");
+        return -EINVAL;
+    }
+    if (mbap.proto_id != 0 || resp_size < MODBUS_MBAP_LENGTH + 2) {
+        return -EINVAL;
+    }
+    if (mbap.unit_id != engine->unit_id && mbap.unit_id != MODBUS_TCP_UNIT_ID) {
+        LOG_DBG("Dropping request for unit %d", mbap.unit_id);
+        return 0;
+    }
+
+    const uint8_t *req_pdu = &req[MODBUS_MBAP_LENGTH];
+    uint16_t req_pdu_len = mbap.length - 1;
+    uint8_t *resp_pdu = &resp[MODBUS_MBAP_LENGTH];
+    uint16_t resp_pdu_size = MIN(resp_size - MODBUS_MBAP_LENGTH, MODBUS_MAX_PDU_LENGTH);
+    uint8_t fc = req_pdu[0];
+
+    int ret = -MODBUS_EXC_ILLEGAL_FUNCTION;
+    for (int i = 0 ; i < engine->table_len ; i++) {
+        if (engine->table[i].fc == fc) {
+            ret = engine->table[i].handler(ctx, req_pdu, req_pdu_len, resp_pdu, resp_pdu_size);
+            break;
+        }
+    }
+
+    if (ret == MODBUS_PDU_DEFERRED) {
+        return ret;
+    }
+
+    if (ret < 0) {
+        LOG_INF("Exception %d for function code %d", -ret, fc);
+        resp_pdu[0] = fc | MODBUS_EXCEPTION_FLAG;
+        resp_pdu[1] = -ret;
+        ret = 2;
+    }
+
+    mbap.length = ret + 1;
+    modbus_mbap_put(&mbap, resp);
+    return MODBUS_MBAP_LENGTH + ret;
+}
@@ -0,0 +1,93 @@
+#ifndef MODBUS_PDU_HEADER_H
+#define MODBUS_PDU_HEADER_H
+
+#include <zephyr/types.h>
+#include <errno.h>
+
+#define MODBUS_MBAP_LENGTH 7
+#define MODBUS_MAX_PDU_LENGTH 253
+#define MODBUS_MAX_ADU_LENGTH (MODBUS_MBAP_LENGTH + MODBUS_MAX_PDU_LENGTH)
+#define MODBUS_MAX_READ_REGISTERS 125
+// MBAP, function code and byte count ahead of the registers of a read response
+#define MODBUS_READ_RESPONSE_OVERHEAD (MODBUS_MBAP_LENGTH + 2)
+
+// ADU bytes of a UDP reply fitting a single 802.15.4 frame, after the MAC
+// header and security, a mesh header and the compressed IPv6 and UDP headers
+#ifdef CONFIG_OPENP1_FRAME_BUDGET
+#define MODBUS_FRAME_BUDGET CONFIG_OPENP1_FRAME_BUDGET
+#else
+#define MODBUS_FRAME_BUDGET 64
+#endif
+// The same for a TCP reply. 6LoWPAN compresses the UDP header to 7 bytes, but
+// not the 20 byte TCP header.
+#define MODBUS_TCP_FRAME_BUDGET (MODBUS_FRAME_BUDGET - 13)
+
+#define MODBUS_FC_READ_HOLDING_REGISTERS 0x03
+#define MODBUS_FC_READ_INPUT_REGISTERS 0x04
+// User defined function code, a read of input registers held until the data changes
+#define MODBUS_FC_LONG_POLL 0x41
+
+#define MODBUS_EXC_ILLEGAL_FUNCTION 0x01
+#define MODBUS_EXC_ILLEGAL_DATA_ADDRESS 0x02
+#define MODBUS_EXC_ILLEGAL_DATA_VALUE 0x03
+#define MODBUS_EXC_SERVER_DEVICE_FAILURE 0x04
+
+// Returned by handlers for requests answered later, instead of a MODBUS_EXC_* code
+#define MODBUS_PDU_DEFERRED (-EAGAIN)
+
+// Long poll request PDU: function code, address, count, last seen generation and
+// timeout in s. The response PDU holds the current generation before the registers.
+#define MODBUS_LONG_POLL_REQUEST_LENGTH 11
+#define MODBUS_LONG_POLL_MAX_REGISTERS (MODBUS_MAX_READ_REGISTERS - 2)
+
+struct modbus_mbap {
+    uint16_t trans_id;
+    uint16_t proto_id;
+    uint16_t length; // Unit id and PDU
+    uint8_t unit_id;
+};
+
+// Writes the response PDU for req (both starting at the function code) into
+// resp. Returns the PDU length, or a negated MODBUS_EXC_* code.
+typedef int (*modbus_fc_handler_t)(void *ctx, const uint8_t *req, uint16_t req_len,
+                                   uint8_t *resp, uint16_t resp_size);
+
+struct modbus_long_poll {
+    uint16_t addr;
+    uint16_t count;
+    uint32_t generation;
+    uint16_t timeout_s;
+};
+
+// Reads count registers from addr as big-endian words into dst. Returns 0 or a MODBUS_EXC_* code.
+typedef int (*modbus_register_reader_t)(void *ctx, uint16_t addr, uint16_t count, uint8_t *dst);
+
+struct modbus_fc_entry {
+    uint8_t fc;
+    modbus_fc_handler_t handler;
+};
+
+struct modbus_pdu_engine {
+    const struct modbus_fc_entry *table;
+    int table_len;
+    uint8_t unit_id;
+};
+
+int modbus_mbap_parse(const uint8_t *buf, size_t len, struct modbus_mbap *mbap);
+void modbus_mbap_put(const struct modbus_mbap *mbap, uint8_t *buf);
+
+// Registers of a read whose response ADU takes at most budget bytes
+uint16_t modbus_read_registers_fitting(uint16_t budget);
+int modbus_pdu_read_registers(const uint8_t *req, uint16_t req_len, uint8_t *resp, uint16_t resp_size,
+                              modbus_register_reader_t reader, void *ctx);
+
+int modbus_long_poll_parse(const uint8_t *req, uint16_t req_len, struct modbus_long_poll *poll);
+int modbus_pdu_long_poll(const uint8_t *req, uint16_t req_len, uint8_t *resp, uint16_t resp_size,
+                         uint32_t generation, bool may_defer, modbus_register_reader_t reader, void *ctx);
+
+// Returns the length of the response ADU, 0 to drop the request, -EINVAL for a
+// malformed ADU or MODBUS_PDU_DEFERRED when a handler answers later
+int modbus_pdu_process(const struct modbus_pdu_engine *engine, void *ctx,
+                       const uint8_t *req, size_t req_len, uint8_t *resp, size_t resp_size);
+
+#endif /* MODBUS_PDU_HEADER_H */
@@ -0,0 +1,75 @@
+#include "modbus_rtu.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(modbus_rtu, LOG_LEVEL_DBG);
+
+#define CRC_POLYNOMIAL 0xa001
+#define CHARACTER_BITS 11 // Start, 8 data, parity or second stop, stop
+#define FIXED_GAP_BAUDRATE 19200
+#define FIXED_GAP_US 1750
+
+// CRC-16/MODBUS, sent low byte first
+uint16_t modbus_rtu_crc(const uint8_t *buf, size_t len) {
+    uint16_t crc = 0xffff;
+    for (size_t i = 0 ; i < len ; i++) {
+        crc ^= buf[i];
+        for (int bit = 0 ; bit < 8 ; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC_POLYNOMIAL : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+uint32_t modbus_rtu_frame_gap_us(uint32_t baudrate) {
+    if (baudrate == 0 || baudrate > FIXED_GAP_BAUDRATE) {
+        return FIXED_GAP_US;
+    }
+    return DIV_ROUND_UP(USEC_PER_SEC * CHARACTER_BITS * 7ULL, baudrate * 2ULL);
+}
+
+int modbus_rtu_to_adu(const uint8_t *frame, size_t len, uint8_t *adu, size_t adu_size) {
+    if (len < MODBUS_RTU_MIN_FRAME_LENGTH || len > MODBUS_RTU_MAX_FRAME_LENGTH) {
+        return -EINVAL;
+    }
+    if (modbus_rtu_crc(frame, len - 2) != sys_get_le16(&frame[len - 2])) {
+        LOG_WRN("CRC error");
+        return -EINVAL;
+    }
+    if (frame[0] == MODBUS_RTU_BROADCAST_ADDRESS) {
+        return 0; // Only reads are served, broadcasts can't be answered
+    }
+
+    uint16_t pdu_len = len - 3;
+    struct modbus_mbap mbap = {
+        .trans_id = 0,
+        .proto_id = 0,
+        .length = pdu_len + 1,
+        .unit_id = frame[0],
+    };
+    if (adu_size < MODBUS_MBAP_LENGTH + pdu_len) {
+        return -EINVAL;
+    }
+    modbus_mbap_put(&mbap, adu);
+    memcpy(&adu[MODBUS_MBAP_LENGTH], &frame[1], pdu_len);
+    return MODBUS_MBAP_LENGTH + pdu_len;
+}
+
+int modbus_rtu_from_adu(const uint8_t *adu, size_t len, uint8_t *frame, size_t frame_size) {
+    struct modbus_mbap mbap;
+    int adu_len = modbus_mbap_parse(adu, len, &mbap);
+    if (adu_len < 0 || adu_len > len) {
+        return -EINVAL;
+    }
+
+    uint16_t pdu_len = mbap.length - 1;
+    if (frame_size < pdu_len + 3) {
+        return -EINVAL;
+    }
+    frame[0] = mbap.unit_id;
+    memcpy(&frame[1], &adu[MODBUS_MBAP_LENGTH], pdu_len);
+    sys_put_le16(modbus_rtu_crc(frame, pdu_len + 1), &frame[pdu_len + 1]);
+    return pdu_len + 3;
+}
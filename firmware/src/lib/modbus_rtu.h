@@ -0,0 +1,26 @@
+#ifndef MODBUS_RTU_HEADER_H
+#define MODBUS_RTU_HEADER_H
+
+#include "modbus_pdu.h"
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+// Address, PDU and CRC
+#define MODBUS_RTU_MAX_FRAME_LENGTH (1 + MODBUS_MAX_PDU_LENGTH + 2)
+#define MODBUS_RTU_MIN_FRAME_LENGTH 4
+#define MODBUS_RTU_BROADCAST_ADDRESS 0
+
+uint16_t modbus_rtu_crc(const uint8_t *buf, size_t len);
+// Silent interval ending a frame, 3.5 characters of 11 bits, fixed above 19200 baud
+uint32_t modbus_rtu_frame_gap_us(uint32_t baudrate);
+
+// Converts an RTU frame to a Modbus TCP ADU for the PDU engine. Returns the ADU
+// length, 0 for frames not to be answered (broadcasts) or -EINVAL on a
+// malformed frame or CRC error.
+int modbus_rtu_to_adu(const uint8_t *frame, size_t len, uint8_t *adu, size_t adu_size);
+// Converts a response ADU from the PDU engine back to an RTU frame. Returns
+// the frame length or -EINVAL.
+int modbus_rtu_from_adu(const uint8_t *adu, size_t len, uint8_t *frame, size_t frame_size);
+
+#endif /* MODBUS_RTU_HEADER_H */
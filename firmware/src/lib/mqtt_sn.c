@@ -0,0 +1,116 @@
+#include "mqtt_sn.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+#define CONNECT_HEADER_LENGTH 6
+#define MAX_VALUE_TEXT 16
+
+int mqtt_sn_encode_connect(uint8_t *buf, size_t size, const char *client_id, uint16_t keep_alive_s) {
+    size_t id_len = strlen(client_id);
+    size_t len = CONNECT_HEADER_LENGTH + id_len;
+
+    if (len > MIN(size, MQTT_SN_MAX_LENGTH)) {
+        return -ENOMEM;
+    }
+    buf[0] = len;
+    buf[1] = MQTT_SN_CONNECT;
+    buf[2] = MQTT_SN_FLAG_CLEAN_SESSION;
+    buf[3] = MQTT_SN_PROTOCOL_ID;
+    sys_put_be16(keep_alive_s, &buf[4]);
+    memcpy(&buf[CONNECT_HEADER_LENGTH], client_id, id_len);
+    return len;
+}
+
+static int encode_empty(uint8_t *buf, size_t size, uint8_t type) {
+    if (size < 2) {
+        return -ENOMEM;
+    }
+    buf[0] = 2;
+    buf[1] = type;
+    return 2;
+}
+
+int mqtt_sn_encode_pingreq(uint8_t *buf, size_t size) {
+    return encode_empty(buf, size, MQTT_SN_PINGREQ);
+}
+
+int mqtt_sn_encode_disconnect(uint8_t *buf, size_t size) {
+    return encode_empty(buf, size, MQTT_SN_DISCONNECT);
+}
+
+int mqtt_sn_encode_publish(uint8_t *buf, size_t size, uint16_t topic_id, size_t payload_len) {
+    size_t len = MQTT_SN_PUBLISH_HEADER_LENGTH + payload_len;
+
+    if (len > MIN(size, MQTT_SN_MAX_LENGTH)) {
+        return -ENOMEM;
+    }
+    buf[0] = len;
+    buf[1] = MQTT_SN_PUBLISH;
+    buf[2] = MQTT_SN_TOPIC_PREDEFINED; // QoS 0, not retained
+    sys_put_be16(topic_id, &buf[3]);
+    sys_put_be16(0, &buf[5]);          // Message id, unused at QoS 0
+    return len;
+}
+
+// Writes value / 10^decimals with all decimals, e.g. "-0.250"
+static int format_value(int64_t value, int decimals, char *text, size_t size) {
+    char digits[MAX_VALUE_TEXT];
+    uint64_t magnitude = value < 0 ? -value : value;
+    int n = 0;
+    size_t len = 0;
+
+    do {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while ((magnitude > 0 || n <= decimals) && n < sizeof(digits));
+
+    if (n + 2 > size) {
+        return -ENOMEM;
+    }
+    if (value < 0) {
+        text[len++] = '-';
+    }
+    while (n > 0) {
+        if (n == decimals) {
+            text[len++] = '.';
+        }
+        text[len++] = digits[--n];
+    }
+    return len;
+}
+
+int mqtt_sn_encode_item(struct value_store *store, enum Item item, uint16_t topic_id,
+                        uint8_t *buf, size_t size) {
+    int64_t value;
+
+    if (item >= _ITEM_COUNT || data_item_numeric_value(&store->rows[item].data, &value) != 0) {
+        return -EINVAL;
+    }
+    if (size <= MQTT_SN_PUBLISH_HEADER_LENGTH) {
+        return -ENOMEM;
+    }
+    int len = format_value(value, data_format_decimals(data_definition_table[item].format),
+                           (char *) &buf[MQTT_SN_PUBLISH_HEADER_LENGTH], size - MQTT_SN_PUBLISH_HEADER_LENGTH);
+    if (len < 0) {
+        return len;
+    }
+    return mqtt_sn_encode_publish(buf, size, topic_id, len);
+}
+
+int mqtt_sn_parse(const uint8_t *buf, size_t len, struct mqtt_sn_message *msg) {
+    // The three byte length form is never sent to us, nor are messages that long
+    if (len < 2 || buf[0] != len) {
+        return -EINVAL;
+    }
+    msg->type = buf[1];
+    msg->return_code = MQTT_SN_ACCEPTED;
+    if (msg->type == MQTT_SN_CONNACK) {
+        if (len != 3) {
+            return -EINVAL;
+        }
+        msg->return_code = buf[2];
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef MQTT_SN_HEADER_H
+#define MQTT_SN_HEADER_H
+
+#include "value_store.h"
+
+#include <zephyr/types.h>
+#include <stddef.h>
+
+// The subset of MQTT-SN 1.2 needed to publish at QoS 0 to pre-defined topic
+// ids, which saves registering topic names. Messages use the one byte length
+// form, so they are at most 255 bytes.
+#define MQTT_SN_CONNECT 0x04
+#define MQTT_SN_CONNACK 0x05
+#define MQTT_SN_PUBLISH 0x0c
+#define MQTT_SN_PINGREQ 0x16
+#define MQTT_SN_PINGRESP 0x17
+#define MQTT_SN_DISCONNECT 0x18
+
+#define MQTT_SN_FLAG_CLEAN_SESSION BIT(2)
+#define MQTT_SN_TOPIC_PREDEFINED 0x01
+#define MQTT_SN_PROTOCOL_ID 0x01
+#define MQTT_SN_ACCEPTED 0x00
+
+// Length, type, flags, topic id and message id, followed by the payload
+#define MQTT_SN_PUBLISH_HEADER_LENGTH 7
+#define MQTT_SN_MAX_LENGTH 255
+
+struct mqtt_sn_message {
+    uint8_t type;
+    uint8_t return_code;       // Of a CONNACK
+};
+
+int mqtt_sn_encode_connect(uint8_t *buf, size_t size, const char *client_id, uint16_t keep_alive_s);
+int mqtt_sn_encode_pingreq(uint8_t *buf, size_t size);
+int mqtt_sn_encode_disconnect(uint8_t *buf, size_t size);
+// Completes a PUBLISH to a pre-defined topic whose payload_len bytes were
+// written at buf + MQTT_SN_PUBLISH_HEADER_LENGTH. Returns its length or -ENOMEM.
+int mqtt_sn_encode_publish(uint8_t *buf, size_t size, uint16_t topic_id, size_t payload_len);
+// A PUBLISH of one item as decimal text in the unit of the item, e.g. "1.500"
+// for 1500 W of active power in kW. Returns its length, -EINVAL for items
+// without a numeric value or -ENOMEM.
+int mqtt_sn_encode_item(struct value_store *store, enum Item item, uint16_t topic_id,
+                        uint8_t *buf, size_t size);
+// Parses a message from the gateway. Returns 0, or -EINVAL if malformed.
+int mqtt_sn_parse(const uint8_t *buf, size_t len, struct mqtt_sn_message *msg);
+
+#endif /* MQTT_SN_HEADER_H */
@@ -1,4 +1,5 @@
 #include "openp1.h"
+#include <stddef.h>
 
 const struct data_definition data_definition_table[] = {
     { DATE_TIME,                    "0-0:1.0.0", DATE_TIME_STRING,         NONE },
@@ -10,4 +11,48 @@ const struct data_definition data_definition_table[] = {
     { ACTIVE_ENERGY_OUT,            "1-0:2.7.0", DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
     { REACTIVE_ENERGY_IN,           "1-0:3.7.0", DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
     { REACTIVE_ENERGY_OUT,          "1-0:4.7.0", DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
+    { ACTIVE_ENERGY_IN_EWMA,        NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { ACTIVE_ENERGY_IN_MIN,         NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { ACTIVE_ENERGY_IN_MAX,         NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { ACTIVE_ENERGY_IN_MEAN,        NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { ACTIVE_ENERGY_OUT_EWMA,       NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { ACTIVE_ENERGY_OUT_MIN,        NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { ACTIVE_ENERGY_OUT_MAX,        NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { ACTIVE_ENERGY_OUT_MEAN,       NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { REACTIVE_ENERGY_IN_EWMA,      NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
+    { REACTIVE_ENERGY_IN_MIN,       NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
+    { REACTIVE_ENERGY_IN_MAX,       NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
+    { REACTIVE_ENERGY_IN_MEAN,      NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
+    { REACTIVE_ENERGY_OUT_EWMA,     NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
+    { REACTIVE_ENERGY_OUT_MIN,      NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
+    { REACTIVE_ENERGY_OUT_MAX,      NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
+    { REACTIVE_ENERGY_OUT_MEAN,     NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_VOLT_AMPERE_REACTIVE },
+    { NET_ACTIVE_ENERGY,            NULL,        DOUBLE_LONG_SIGNED_4_3,   K_WATT },
+    { METER_NET_ACTIVE_ENERGY,      NULL,        DOUBLE_LONG_SIGNED_8_3,   K_WATT_HOUR },
+    { DEMAND_AVERAGE,               NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { DEMAND_PROJECTED,             NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
+    { DEMAND_MONTH_PEAK,            NULL,        DOUBLE_LONG_UNSIGNED_4_3, K_WATT },
 };
+
+const struct derived_definition derived_definition_table[] = {
+    { ACTIVE_ENERGY_IN_EWMA,        AGGREGATE_EWMA, ACTIVE_ENERGY_IN,       _ITEM_COUNT },
+    { ACTIVE_ENERGY_IN_MIN,         AGGREGATE_MIN,  ACTIVE_ENERGY_IN,       _ITEM_COUNT },
+    { ACTIVE_ENERGY_IN_MAX,         AGGREGATE_MAX,  ACTIVE_ENERGY_IN,       _ITEM_COUNT },
+    { ACTIVE_ENERGY_IN_MEAN,        AGGREGATE_MEAN, ACTIVE_ENERGY_IN,       _ITEM_COUNT },
+    { ACTIVE_ENERGY_OUT_EWMA,       AGGREGATE_EWMA, ACTIVE_ENERGY_OUT,      _ITEM_COUNT },
+    { ACTIVE_ENERGY_OUT_MIN,        AGGREGATE_MIN,  ACTIVE_ENERGY_OUT,      _ITEM_COUNT },
+    { ACTIVE_ENERGY_OUT_MAX,        AGGREGATE_MAX,  ACTIVE_ENERGY_OUT,      _ITEM_COUNT },
+    { ACTIVE_ENERGY_OUT_MEAN,       AGGREGATE_MEAN, ACTIVE_ENERGY_OUT,      _ITEM_COUNT },
+    { REACTIVE_ENERGY_IN_EWMA,      AGGREGATE_EWMA, REACTIVE_ENERGY_IN,     _ITEM_COUNT },
+    { REACTIVE_ENERGY_IN_MIN,       AGGREGATE_MIN,  REACTIVE_ENERGY_IN,     _ITEM_COUNT },
+    { REACTIVE_ENERGY_IN_MAX,       AGGREGATE_MAX,  REACTIVE_ENERGY_IN,     _ITEM_COUNT },
+    { REACTIVE_ENERGY_IN_MEAN,      AGGREGATE_MEAN, REACTIVE_ENERGY_IN,     _ITEM_COUNT },
+    { REACTIVE_ENERGY_OUT_EWMA,     AGGREGATE_EWMA, REACTIVE_ENERGY_OUT,    _ITEM_COUNT },
+    { REACTIVE_ENERGY_OUT_MIN,      AGGREGATE_MIN,  REACTIVE_ENERGY_OUT,    _ITEM_COUNT },
+    { REACTIVE_ENERGY_OUT_MAX,      AGGREGATE_MAX,  REACTIVE_ENERGY_OUT,    _ITEM_COUNT },
+    { REACTIVE_ENERGY_OUT_MEAN,     AGGREGATE_MEAN, REACTIVE_ENERGY_OUT,    _ITEM_COUNT },
+    { NET_ACTIVE_ENERGY,            AGGREGATE_NET,  ACTIVE_ENERGY_IN,       ACTIVE_ENERGY_OUT },
+    { METER_NET_ACTIVE_ENERGY,      AGGREGATE_NET,  METER_ACTIVE_ENERGY_IN, METER_ACTIVE_ENERGY_OUT },
+};
+
+const int derived_definition_count = sizeof(derived_definition_table) / sizeof(derived_definition_table[0]);
@@ -9,6 +9,8 @@ enum Format {
     DOUBLE_LONG_UNSIGNED_4_3,
     LONG_UNSIGNED_3_1,
     LONG_SIGNED_3_1,
+    DOUBLE_LONG_SIGNED_8_3,
+    DOUBLE_LONG_SIGNED_4_3,
 };
 
 enum Item {
@@ -21,6 +23,28 @@ enum Item {
     ACTIVE_ENERGY_OUT,
     REACTIVE_ENERGY_IN,
     REACTIVE_ENERGY_OUT,
+    // Virtual items, derived from the above as telegrams are applied
+    ACTIVE_ENERGY_IN_EWMA,
+    ACTIVE_ENERGY_IN_MIN,
+    ACTIVE_ENERGY_IN_MAX,
+    ACTIVE_ENERGY_IN_MEAN,
+    ACTIVE_ENERGY_OUT_EWMA,
+    ACTIVE_ENERGY_OUT_MIN,
+    ACTIVE_ENERGY_OUT_MAX,
+    ACTIVE_ENERGY_OUT_MEAN,
+    REACTIVE_ENERGY_IN_EWMA,
+    REACTIVE_ENERGY_IN_MIN,
+    REACTIVE_ENERGY_IN_MAX,
+    REACTIVE_ENERGY_IN_MEAN,
+    REACTIVE_ENERGY_OUT_EWMA,
+    REACTIVE_ENERGY_OUT_MIN,
+    REACTIVE_ENERGY_OUT_MAX,
+    REACTIVE_ENERGY_OUT_MEAN,
+    NET_ACTIVE_ENERGY,
+    METER_NET_ACTIVE_ENERGY,
+    DEMAND_AVERAGE,
+    DEMAND_PROJECTED,
+    DEMAND_MONTH_PEAK,
     _ITEM_COUNT,
 };
 
@@ -42,6 +66,27 @@ struct data_definition {
     enum Unit unit;
 };
 
+enum Aggregate {
+    AGGREGATE_EWMA,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX,
+    AGGREGATE_MEAN,
+    AGGREGATE_NET, // source - subtrahend
+};
+
+struct derived_definition {
+    enum Item item;
+    enum Aggregate aggregate;
+    enum Item source;
+    enum Item subtrahend;
+};
+
 extern const struct data_definition data_definition_table[];
+extern const struct derived_definition derived_definition_table[];
+extern const int derived_definition_count;
+
+// Virtual items follow the meter items, have no OBIS code and are never parsed
+#define FIRST_VIRTUAL_ITEM ACTIVE_ENERGY_IN_EWMA
+#define IS_VIRTUAL_ITEM(item) ((item) >= FIRST_VIRTUAL_ITEM)
 
 #endif /* OPENP1_HEADER_H */
\ No newline at end of file
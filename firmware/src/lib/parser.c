@@ -144,6 +144,9 @@ uint8_t * parse_header(struct parser *parser, char *line) {
 const struct data_definition * parse_obis(struct parser *parser, char *obis) {
     // Linear search is good enough for now
     for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (IS_VIRTUAL_ITEM(i)) {
+            continue;
+        }
         if (strcmp(obis, data_definition_table[i].obis) == 0) {
             return &data_definition_table[i];
         }
@@ -293,7 +296,7 @@ int parse_data_line(struct parser *parser, struct data_item *data_item, char *li
         LOG_ERR("Failed to parse dataline (%d) from: %s", err, line);
         return -1;
     }
-    // strtok_r is already destructive, these are safe from indexing perspective
+    // The line is a copy, these are safe from indexing perspective
     line[pmatch[1].rm_eo] = '\0';
     line[pmatch[2].rm_eo] = '\0';
     char *obis = &line[pmatch[1].rm_so];
@@ -322,29 +325,64 @@ int parse_data_line(struct parser *parser, struct data_item *data_item, char *li
     return 0;
 }
 
+// Copies the next line of the frame in [*pos, end) into the line buffer of the
+// parser. Returns its length, 0 at the end of the frame or its checksum line, or
+// -ENOMEM for a line too long, which is skipped.
+static int next_line(struct parser *parser, const char **pos, const char *end) {
+    const char *start;
+    size_t len;
+
+    while (*pos < end && (**pos == '\r' || **pos == '\n')) {
+        (*pos)++;
+    }
+    if (*pos == end || **pos == '!') {
+        return 0;
+    }
+    start = *pos;
+    while (*pos < end && **pos != '\r' && **pos != '\n') {
+        (*pos)++;
+    }
+    len = *pos - start;
+    if (len >= sizeof(parser->line)) {
+        return -ENOMEM;
+    }
+    memcpy(parser->line, start, len);
+    parser->line[len] = '\0';
+    return len;
+}
+
+// Parses a frame without modifying it, so that it may be shared, e.g. with
+// raw telegram subscribers. The frame ends at its checksum line or a NUL.
 struct telegram * parse_telegram(struct parser *parser, struct net_buf *telegram_buf) {
     struct telegram *telegram = telegram_init();
     if (telegram == NULL) {
         return NULL;
     }
-    char *line;
-    char *rest = telegram_buf->data;
-    line = strtok_r(rest, "\r\n", &rest);
-    if (line == NULL) {
+    const char *pos = telegram_buf->data;
+    const char *end = memchr(pos, '\0', telegram_buf->len);
+    if (end == NULL) {
+        end = pos + telegram_buf->len;
+    }
+    int len = next_line(parser, &pos, end);
+    if (len <= 0) {
         LOG_INF("First line not found");
         goto failure;
     }
     int err;
-    uint8_t *identifier = parse_header(parser, line);
+    uint8_t *identifier = parse_header(parser, parser->line);
     if (identifier == NULL) {
         LOG_WRN("Could not parse header");
         goto failure;
     }
     telegram->identifier = identifier;
 
-    while ((line = strtok_r(rest, "\r\n", &rest))) {
+    while ((len = next_line(parser, &pos, end)) != 0) {
         struct data_item data_item;
-        err = parse_data_line(parser, &data_item, line);
+        if (len < 0) {
+            LOG_WRN("Skipping line longer than %d", PARSER_MAX_LINE_LENGTH - 1);
+            continue;
+        }
+        err = parse_data_line(parser, &data_item, parser->line);
         if (err < 0) {
             goto failure;
         } 
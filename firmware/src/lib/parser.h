@@ -8,6 +8,9 @@
 #include "openp1.h"
 #include "telegram.h"
 
+// Longer lines are skipped, no item of the data definitions comes close
+#define PARSER_MAX_LINE_LENGTH 128
+
 struct parser {
     regex_t header_regex;
     regex_t footer_regex;
@@ -23,6 +26,8 @@ struct parser {
     regex_t unit_kvar_regex;
     regex_t unit_volt_regex;
     regex_t unit_ampere_regex;
+    // Copy of the line being parsed, frames are shared and never written
+    char line[PARSER_MAX_LINE_LENGTH];
 };
 
 struct parser * parser_init();
@@ -0,0 +1,123 @@
+#include "push.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+
+LOG_MODULE_REGISTER(push, LOG_LEVEL_DBG);
+
+void push_init(struct push_state *state) {
+    memset(state, 0, sizeof(*state));
+    state->last_round = NEVER_UPDATED;
+    state->last_full = NEVER_UPDATED;
+}
+
+static int32_t item_value(struct value_store *store, enum Item item) {
+    int64_t value = 0;
+    data_item_numeric_value(&store->rows[item].data, &value);
+    return CLAMP(value, INT32_MIN, INT32_MAX);
+}
+
+static bool publishable(struct value_store *store, enum Item item) {
+    int64_t value;
+    return value_store_is_fresh(store, item) && data_item_numeric_value(&store->rows[item].data, &value) == 0;
+}
+
+int push_collect(struct push_state *state, const struct push_config *config,
+                 struct value_store *store, int64_t now) {
+    int count = 0;
+
+    if (state->last_round != NEVER_UPDATED && now - state->last_round < config->min_interval_ms) {
+        return 0;
+    }
+    state->full = state->last_full == NEVER_UPDATED || now - state->last_full >= config->full_interval_ms;
+    state->pending = 0;
+
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (!publishable(store, i)) {
+            continue;
+        }
+        if (state->full || !(state->published & BIT64(i)) ||
+            llabs((int64_t) item_value(store, i) - state->sent[i]) > config->deadband) {
+            state->pending |= BIT64(i);
+            count++;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    state->last_round = now;
+    if (state->full) {
+        state->last_full = now;
+    }
+    state->generation = store->generation;
+    if (state->full) {
+        snapshot_base_init(&state->base, state->generation);
+    }
+    return count;
+}
+
+static void mark_sent(struct push_state *state, struct value_store *store, enum Item item) {
+    state->sent[item] = item_value(store, item);
+    state->published |= BIT64(item);
+    state->pending &= ~BIT64(item);
+    if (state->full) {
+        snapshot_base_put(&state->base, &store->rows[item].data);
+    }
+}
+
+// A telegram was applied, or items turned stale, since the round was collected.
+// Datagrams carry the generation of the values in them, so the rest of the round
+// goes out with the new one. A full round starts over, so that its base holds
+// values of a single generation.
+static void restart_round(struct push_state *state, struct value_store *store) {
+    state->generation = store->generation;
+    if (state->full) {
+        snapshot_base_init(&state->base, state->generation);
+        state->pending = 0;
+    }
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (!publishable(store, i)) {
+            state->pending &= ~BIT64(i);
+        } else if (state->full) {
+            state->pending |= BIT64(i);
+        }
+    }
+}
+
+int push_encode(struct push_state *state, struct value_store *store, uint8_t *buf, size_t size) {
+    struct snapshot_writer writer;
+
+    if (state->pending != 0 && store->generation != state->generation) {
+        restart_round(state, store);
+    }
+    if (state->pending == 0) {
+        return 0;
+    }
+
+    snapshot_writer_init(&writer, buf, size, state->generation, state->full ? NULL : &state->base, 0, 0);
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (!(state->pending & BIT64(i))) {
+            continue;
+        }
+        if (snapshot_put_item(&writer, store, i) == -ENOMEM) {
+            break;
+        }
+        mark_sent(state, store, i);
+    }
+    if (writer.count == 0) {
+        return -ENOMEM;
+    }
+
+    return snapshot_writer_finish(&writer, (state->full ? SNAPSHOT_FLAG_FULL : 0) |
+                                           (state->pending != 0 ? SNAPSHOT_FLAG_MORE : 0));
+}
+
+void push_commit(struct push_state *state, struct value_store *store) {
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (state->pending & BIT64(i)) {
+            mark_sent(state, store, i);
+        }
+    }
+}
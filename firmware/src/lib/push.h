@@ -0,0 +1,44 @@
+#ifndef PUSH_HEADER_H
+#define PUSH_HEADER_H
+
+#include "value_store.h"
+#include "snapshot.h"
+
+#include <zephyr/types.h>
+
+// Datagrams are snapshots of the changed items. Counters of rounds between
+// full rounds are relative to the last full round, so that a lost datagram
+// only loses its own items.
+
+struct push_config {
+    uint32_t min_interval_ms;  // Between rounds, changes wait for the next telegram
+    uint32_t full_interval_ms; // Between rounds sending all items, for late subscribers
+    int32_t deadband;          // Changes up to this, in units of the last decimal, are not sent
+};
+
+struct push_state {
+    int64_t last_round;
+    int64_t last_full;
+    uint32_t generation;
+    bool full;
+    uint64_t pending;          // Items of the round still to be encoded
+    uint64_t published;        // Items with a value in sent
+    int32_t sent[_ITEM_COUNT];
+    struct snapshot_base base; // Counters of the last full round
+};
+
+void push_init(struct push_state *state);
+// Starts a round after a telegram was applied. Returns the number of items
+// to send, 0 when rate limited or nothing changed beyond the deadband.
+int push_collect(struct push_state *state, const struct push_config *config,
+                 struct value_store *store, int64_t now);
+// Encodes pending items of the round into one datagram of at most size bytes.
+// Returns its length, 0 once the round is done, or -ENOMEM. Called with the
+// store locked, which may be released between datagrams: the round restarts
+// at the new generation if the store changed.
+int push_encode(struct push_state *state, struct value_store *store, uint8_t *buf, size_t size);
+// Marks the pending items of the round as sent, for rounds announced otherwise,
+// e.g. as CoAP notifications
+void push_commit(struct push_state *state, struct value_store *store);
+
+#endif /* PUSH_HEADER_H */
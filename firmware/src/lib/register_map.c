@@ -0,0 +1,273 @@
+#include "register_map.h"
+#include "value_store.h"
+#include "modbus_pdu.h"
+#include "stats.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(register_map, LOG_LEVEL_DBG);
+
+// Reads registers [offset, offset + count) of the slot of one item. A strict
+// read, from a request within a single slot, fails on stale values and padding.
+// Restored values are served with their own status, unless fresh_only.
+static int read_item(struct value_store *store, uint16_t item, uint16_t offset, uint16_t count,
+                     uint8_t *dst, bool strict, bool fresh_only) {
+    uint16_t size = value_store_item_registers(item);
+    bool status_only = count == 1 && offset == DATA_STATUS_OFFSET;
+    enum data_status status = DATA_STATUS_STALE;
+
+    if (value_store_is_fresh(store, item)) {
+        status = DATA_STATUS_FRESH;
+    } else if (!fresh_only && value_store_is_restored(store, item)) {
+        status = DATA_STATUS_RESTORED;
+    }
+
+    if (strict && !status_only) {
+        if (offset + count > size) {
+            LOG_WRN("Read failure; invalid offset");
+            return MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+        }
+        if (status == DATA_STATUS_STALE) {
+            LOG_INF("Read failure; stale value");
+            return MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+        }
+    }
+
+    memset(dst, 0, count * 2);
+    if (status != DATA_STATUS_STALE && offset < size) {
+        value_store_read_registers(store, item, offset, MIN(count, size - offset), dst);
+    }
+    if (offset + count > DATA_STATUS_OFFSET) {
+        sys_put_be16(status, &dst[(DATA_STATUS_OFFSET - offset) * 2]);
+    }
+    return 0;
+}
+
+static int read_data(struct value_store *store, uint16_t addr, uint16_t count, uint8_t *dst,
+                     bool fresh_only) {
+    if (addr + count > DATA_END_ADDRESS) {
+        LOG_WRN("Read failure; invalid item");
+        return MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+    }
+
+    uint16_t value_addr = addr - DATA_BASE_ADDRESS;
+    bool strict = value_addr % DATA_ITEM_REGISTERS + count <= DATA_ITEM_REGISTERS;
+
+    while (count > 0) {
+        uint16_t item = value_addr / DATA_ITEM_REGISTERS;
+        uint16_t offset = value_addr % DATA_ITEM_REGISTERS;
+        uint16_t n = MIN(count, DATA_ITEM_REGISTERS - offset);
+
+        int exc = read_item(store, item, offset, n, dst, strict, fresh_only);
+        if (exc != 0) {
+            return exc;
+        }
+        value_addr += n;
+        count -= n;
+        dst += n * 2;
+    }
+    return 0;
+}
+
+// Writes registers [offset, offset + count) of the history window of one item.
+// Samples are decoded oldest first while the window is newest first.
+static void read_item_history(struct value_store *store, int64_t now, uint16_t item,
+                              uint16_t offset, uint16_t count, uint8_t *dst) {
+    // No sample, reads as age 0xffffffff
+    memset(dst, 0xff, count * 2);
+    if (IS_VIRTUAL_ITEM(item)) {
+        return;
+    }
+
+    struct history *history = &store->history[item];
+    struct history_iterator iter;
+    struct history_sample *sample;
+    int total = history_count(history);
+    int i = total;
+
+    history_iterator_init(history, &iter);
+    while (NULL != (sample = history_iterator_next(&iter))) {
+        int first = --i * HISTORY_SAMPLE_REGISTERS;
+        if (first >= offset + count || first + HISTORY_SAMPLE_REGISTERS <= offset) {
+            continue;
+        }
+        uint8_t words[HISTORY_SAMPLE_REGISTERS * 2];
+        sys_put_be32(MIN(now - sample->timestamp, UINT32_MAX), &words[0]);
+        sys_put_be32((uint32_t) sample->value, &words[4]);
+        for (int j = 0 ; j < HISTORY_SAMPLE_REGISTERS ; j++) {
+            int reg = first + j;
+            if (reg >= offset && reg < offset + count) {
+                memcpy(&dst[(reg - offset) * 2], &words[j * 2], 2);
+            }
+        }
+    }
+}
+
+static int read_history(struct value_store *store, int64_t now, uint16_t addr, uint16_t count, uint8_t *dst) {
+    while (count > 0) {
+        uint16_t history_addr = addr - HISTORY_BASE_ADDRESS;
+        uint16_t item = history_addr / HISTORY_ITEM_REGISTERS;
+        uint16_t offset = history_addr % HISTORY_ITEM_REGISTERS;
+        uint16_t n = MIN(count, HISTORY_ITEM_REGISTERS - offset);
+
+        if (item >= _ITEM_COUNT) {
+            LOG_WRN("Read failure; invalid history item");
+            return MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+        }
+        read_item_history(store, now, item, offset, n, dst);
+        addr += n;
+        count -= n;
+        dst += n * 2;
+    }
+    return 0;
+}
+
+static const struct sunspec_identity *sunspec_identity;
+static bool dense_enabled;
+
+static bool is_numeric(enum Item item) {
+    return data_definition_table[item].format != DATE_TIME_STRING;
+}
+
+int register_map_dense_items(void) {
+    int count = 0;
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (is_numeric(i)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static uint32_t dense_value(struct value_store *store, enum Item item, bool as_float) {
+    int64_t value;
+    if (!value_store_is_fresh(store, item) || data_item_numeric_value(&store->rows[item].data, &value) != 0) {
+        return as_float ? 0x7fc00000 : (uint32_t) INT32_MIN; // Quiet NaN
+    }
+    if (!as_float) {
+        return (uint32_t) CLAMP(value, INT32_MIN + 1, INT32_MAX);
+    }
+
+    float scaled = value;
+    for (int i = data_format_decimals(data_definition_table[item].format) ; i > 0 ; i--) {
+        scaled /= 10;
+    }
+    uint32_t bits;
+    memcpy(&bits, &scaled, sizeof(bits));
+    return bits;
+}
+
+static int read_dense(struct value_store *store, uint16_t base, uint16_t addr, uint16_t count, uint8_t *dst) {
+    uint16_t first = addr - base;
+    int reg = 0;
+
+    if (!dense_enabled || first + count > register_map_dense_items() * 2) {
+        LOG_WRN("Read failure; invalid dense register");
+        return MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+    }
+
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (!is_numeric(i)) {
+            continue;
+        }
+        if (reg + 2 > first && reg < first + count) {
+            uint8_t words[4];
+            sys_put_be32(dense_value(store, i, base == DENSE_FLOAT32_BASE_ADDRESS), words);
+            for (int j = 0 ; j < 2 ; j++) {
+                if (reg + j >= first && reg + j < first + count) {
+                    memcpy(&dst[(reg + j - first) * 2], &words[j * 2], 2);
+                }
+            }
+        }
+        reg += 2;
+    }
+    return 0;
+}
+
+static int read_system(struct value_store *store, int64_t now, uint16_t addr, uint16_t count, uint8_t *dst) {
+    uint8_t regs[SYSTEM_REGISTERS * 2];
+    uint32_t age = UINT32_MAX;
+
+    if (addr + count > SYSTEM_REGISTERS) {
+        LOG_WRN("Read failure; invalid system register");
+        return MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+    }
+    if (store->last_telegram != NEVER_UPDATED) {
+        age = MIN(now - store->last_telegram, UINT32_MAX - 1);
+    }
+
+    sys_put_be32(store->generation, &regs[SYSTEM_GENERATION * 2]);
+    sys_put_be32(store->telegrams, &regs[SYSTEM_TELEGRAMS * 2]);
+    sys_put_be32(age, &regs[SYSTEM_DATA_AGE * 2]);
+    sys_put_be32(store->telegram_interval, &regs[SYSTEM_TELEGRAM_INTERVAL * 2]);
+    sys_put_be32(stats_get(STAT_FRAMES), &regs[SYSTEM_FRAMES * 2]);
+    sys_put_be32(stats_get(STAT_FRAMES_INCOMPLETE), &regs[SYSTEM_FRAMES_INCOMPLETE * 2]);
+    sys_put_be32(stats_get(STAT_PARSE_ERRORS), &regs[SYSTEM_PARSE_ERRORS * 2]);
+    sys_put_be32(stats_get(STAT_TELEGRAMS_DISCARDED), &regs[SYSTEM_TELEGRAMS_DISCARDED * 2]);
+    sys_put_be32(stats_get(STAT_MODBUS_REQUESTS), &regs[SYSTEM_MODBUS_REQUESTS * 2]);
+    sys_put_be32(stats_get(STAT_MODBUS_CACHE_HITS), &regs[SYSTEM_MODBUS_CACHE_HITS * 2]);
+    sys_put_be32(MODBUS_FRAME_BUDGET, &regs[SYSTEM_FRAME_BUDGET * 2]);
+    sys_put_be32(modbus_read_registers_fitting(MODBUS_FRAME_BUDGET), &regs[SYSTEM_FRAME_REGISTERS * 2]);
+    sys_put_be32(stats_get(STAT_REPLIES_UNFRAGMENTED), &regs[SYSTEM_REPLIES_UNFRAGMENTED * 2]);
+    sys_put_be32(stats_get(STAT_REPLIES_FRAGMENTED), &regs[SYSTEM_REPLIES_FRAGMENTED * 2]);
+    sys_put_be32(modbus_read_registers_fitting(MODBUS_TCP_FRAME_BUDGET), &regs[SYSTEM_TCP_FRAME_REGISTERS * 2]);
+
+    memcpy(dst, &regs[addr * 2], count * 2);
+    return 0;
+}
+
+static int read_input(struct value_store *store, int64_t now, uint16_t addr, uint16_t count,
+                      uint8_t *dst, bool fresh_only) {
+    if (addr >= DENSE_FLOAT32_BASE_ADDRESS && addr < DENSE_FLOAT32_BASE_ADDRESS + DENSE_WINDOW_REGISTERS) {
+        return read_dense(store, DENSE_FLOAT32_BASE_ADDRESS, addr, count, dst);
+    }
+    if (addr >= DENSE_INT32_BASE_ADDRESS && addr < DENSE_INT32_BASE_ADDRESS + DENSE_WINDOW_REGISTERS) {
+        return read_dense(store, DENSE_INT32_BASE_ADDRESS, addr, count, dst);
+    }
+    if (addr < DATA_BASE_ADDRESS) {
+        return read_system(store, now, addr, count, dst);
+    }
+    if (addr >= SUNSPEC_BASE_ADDRESS) {
+        if (sunspec_identity == NULL) {
+            return MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+        }
+        return sunspec_read(store, sunspec_identity, addr, count, dst);
+    }
+    if (addr >= HISTORY_BASE_ADDRESS) {
+        return read_history(store, now, addr, count, dst);
+    }
+    return read_data(store, addr, count, dst, fresh_only);
+}
+
+// Reads count input registers at addr, as big-endian words, from a store
+// expired at time now. Returns 0 or a MODBUS_EXC_* code.
+int register_map_read_input(struct value_store *store, int64_t now,
+                            uint16_t addr, uint16_t count, uint8_t *dst) {
+    return read_input(store, now, addr, count, dst, false);
+}
+
+int register_map_read_fresh_input(struct value_store *store, int64_t now,
+                                  uint16_t addr, uint16_t count, uint8_t *dst) {
+    return read_input(store, now, addr, count, dst, true);
+}
+
+// Only the dense and data windows and the SunSpec block are independent of the time of the
+// request, history samples are served with their age
+bool register_map_cacheable(uint8_t fc, uint16_t addr, uint16_t count) {
+    if (fc != MODBUS_FC_READ_INPUT_REGISTERS && fc != MODBUS_FC_READ_HOLDING_REGISTERS) {
+        return false;
+    }
+    return (addr >= DENSE_INT32_BASE_ADDRESS && addr + count <= DENSE_FLOAT32_BASE_ADDRESS + DENSE_WINDOW_REGISTERS) ||
+           (addr >= DATA_BASE_ADDRESS && addr + count <= DATA_END_ADDRESS) ||
+           addr >= SUNSPEC_BASE_ADDRESS;
+}
+
+void register_map_enable_dense(void) {
+    dense_enabled = true;
+}
+
+void register_map_enable_sunspec(const struct sunspec_identity *identity) {
+    sunspec_identity = identity;
+}
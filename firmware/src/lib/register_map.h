@@ -0,0 +1,66 @@
+#ifndef REGISTER_MAP_HEADER_H
+#define REGISTER_MAP_HEADER_H
+
+#include "value_store.h"
+#include "sunspec.h"
+
+// System registers, uint32 each, from address 0
+enum system_register {
+    SYSTEM_GENERATION = 0,             // Changes with every telegram, and when an item turns stale
+    SYSTEM_TELEGRAMS = 2,              // Telegrams applied since boot
+    SYSTEM_DATA_AGE = 4,               // ms since the last telegram, 0xffffffff before the first or a restore
+    SYSTEM_TELEGRAM_INTERVAL = 6,      // Smoothed ms between telegrams, 0 until known
+    SYSTEM_FRAMES = 8,
+    SYSTEM_FRAMES_INCOMPLETE = 10,
+    SYSTEM_PARSE_ERRORS = 12,
+    SYSTEM_TELEGRAMS_DISCARDED = 14,
+    SYSTEM_MODBUS_REQUESTS = 16,
+    SYSTEM_MODBUS_CACHE_HITS = 18,
+    SYSTEM_FRAME_BUDGET = 20,          // ADU bytes of a UDP reply fitting one link frame
+    SYSTEM_FRAME_REGISTERS = 22,       // Registers of a read whose UDP reply fits one frame
+    SYSTEM_REPLIES_UNFRAGMENTED = 24,
+    SYSTEM_REPLIES_FRAGMENTED = 26,
+    SYSTEM_TCP_FRAME_REGISTERS = 28,   // Registers of a read whose TCP reply fits one frame
+    SYSTEM_REGISTERS = 30,
+};
+
+// Dense windows of every numeric item in definition table order, 2 registers
+// each, as int32 in units of the last decimal or as float32 in the unit of the item.
+// Stale items read as INT32_MIN or NaN.
+#define DENSE_INT32_BASE_ADDRESS 0x0100
+#define DENSE_FLOAT32_BASE_ADDRESS 0x0200
+#define DENSE_WINDOW_REGISTERS 0x0100
+
+// Map Items to DATA_BASE_ADDRESS + item number * 32. The last register of
+// each slot is a status word, see enum data_status.
+// Reads spanning several items zero-fill the unused and stale registers.
+#define DATA_BASE_ADDRESS 0x0800
+#define DATA_ITEM_REGISTERS 32
+#define DATA_STATUS_OFFSET (DATA_ITEM_REGISTERS - 1)
+#define DATA_END_ADDRESS (DATA_BASE_ADDRESS + _ITEM_COUNT * DATA_ITEM_REGISTERS)
+
+enum data_status {
+    DATA_STATUS_STALE = 0,
+    DATA_STATUS_FRESH = 1,
+    DATA_STATUS_RESTORED = 2,          // Restored from before boot, not sent by the meter since
+};
+
+// Map item history to HISTORY_BASE_ADDRESS + item number * HISTORY_ITEM_REGISTERS,
+// newest sample first, each sample as uint32 age in ms followed by uint32 value
+#define HISTORY_BASE_ADDRESS 0x1000
+#define HISTORY_SAMPLE_REGISTERS 4
+#define HISTORY_ITEM_REGISTERS (HISTORY_DEPTH * HISTORY_SAMPLE_REGISTERS)
+
+int register_map_read_input(struct value_store *store, int64_t now,
+                            uint16_t addr, uint16_t count, uint8_t *dst);
+// The same, with restored values read as stale
+int register_map_read_fresh_input(struct value_store *store, int64_t now,
+                                  uint16_t addr, uint16_t count, uint8_t *dst);
+bool register_map_cacheable(uint8_t fc, uint16_t addr, uint16_t count);
+// Serves the dense windows, not served before this is called
+void register_map_enable_dense(void);
+int register_map_dense_items(void);
+// Serves the SunSpec block from SUNSPEC_BASE_ADDRESS, not served before this is called
+void register_map_enable_sunspec(const struct sunspec_identity *identity);
+
+#endif /* REGISTER_MAP_HEADER_H */
@@ -0,0 +1,70 @@
+#include "response_cache.h"
+
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+
+void response_cache_init(struct response_cache *cache, response_cacheable_t cacheable) {
+    memset(cache, 0, sizeof(*cache));
+    cache->cacheable = cacheable;
+}
+
+static bool is_cacheable(struct response_cache *cache, const uint8_t *req, uint16_t req_len) {
+    if (req_len != RESPONSE_CACHE_REQUEST_LENGTH) {
+        return false;
+    }
+    const uint8_t *pdu = &req[MODBUS_MBAP_LENGTH];
+    return cache->cacheable(pdu[0], sys_get_be16(&pdu[1]), sys_get_be16(&pdu[3]));
+}
+
+static struct response_cache_entry *find(struct response_cache *cache, const uint8_t *req) {
+    for (int i = 0 ; i < RESPONSE_CACHE_ENTRIES ; i++) {
+        struct response_cache_entry *entry = &cache->entries[i];
+        if (entry->valid && memcmp(entry->key, &req[2], RESPONSE_CACHE_KEY_LENGTH) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+int response_cache_lookup(struct response_cache *cache, uint32_t generation,
+                          const uint8_t *req, uint16_t req_len, uint8_t *resp, uint16_t resp_size) {
+    if (!is_cacheable(cache, req, req_len)) {
+        return 0;
+    }
+
+    struct response_cache_entry *entry = find(cache, req);
+    if (entry == NULL || entry->generation != generation || entry->len > resp_size) {
+        cache->misses++;
+        return 0;
+    }
+
+    entry->last_used = ++cache->use_count;
+    cache->hits++;
+    memcpy(resp, entry->adu, entry->len);
+    memcpy(resp, req, 2); // Transaction id
+    return entry->len;
+}
+
+void response_cache_store(struct response_cache *cache, uint32_t generation,
+                          const uint8_t *req, uint16_t req_len, const uint8_t *resp, uint16_t resp_len) {
+    if (!is_cacheable(cache, req, req_len) || resp_len > MODBUS_MAX_ADU_LENGTH) {
+        return;
+    }
+
+    struct response_cache_entry *entry = find(cache, req);
+    if (entry == NULL) {
+        entry = &cache->entries[0];
+        for (int i = 1 ; i < RESPONSE_CACHE_ENTRIES ; i++) {
+            if (cache->entries[i].last_used < entry->last_used) {
+                entry = &cache->entries[i];
+            }
+        }
+    }
+
+    entry->valid = true;
+    entry->generation = generation;
+    entry->last_used = ++cache->use_count;
+    memcpy(entry->key, &req[2], RESPONSE_CACHE_KEY_LENGTH);
+    memcpy(entry->adu, resp, resp_len);
+    entry->len = resp_len;
+}
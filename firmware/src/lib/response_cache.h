@@ -0,0 +1,53 @@
+#ifndef RESPONSE_CACHE_HEADER_H
+#define RESPONSE_CACHE_HEADER_H
+
+#include "modbus_pdu.h"
+
+#include <zephyr/types.h>
+
+#ifdef CONFIG_OPENP1_RESPONSE_CACHE_ENTRIES
+#define RESPONSE_CACHE_ENTRIES CONFIG_OPENP1_RESPONSE_CACHE_ENTRIES
+#else
+#define RESPONSE_CACHE_ENTRIES 4
+#endif
+
+// Read requests are a fixed size ADU: MBAP header, function code, address and count
+#define RESPONSE_CACHE_REQUEST_LENGTH (MODBUS_MBAP_LENGTH + 5)
+// Request bytes after the transaction id, the unit id, function code, address and count among them
+#define RESPONSE_CACHE_KEY_LENGTH (RESPONSE_CACHE_REQUEST_LENGTH - 2)
+
+// Whether the response to a read of count registers at addr only depends on the
+// store generation, i.e. not on the time of the request
+typedef bool (*response_cacheable_t)(uint8_t fc, uint16_t addr, uint16_t count);
+
+struct response_cache_entry {
+    bool valid;
+    uint32_t generation;
+    uint32_t last_used;
+    uint8_t key[RESPONSE_CACHE_KEY_LENGTH];
+    uint16_t len;
+    uint8_t adu[MODBUS_MAX_ADU_LENGTH];
+};
+
+// Encoded responses to recent read requests, valid while the store generation
+// they were encoded from is current. Not locked, callers serialize access.
+struct response_cache {
+    response_cacheable_t cacheable;
+    struct response_cache_entry entries[RESPONSE_CACHE_ENTRIES];
+    uint32_t use_count;
+    uint32_t hits;
+    uint32_t misses;
+};
+
+void response_cache_init(struct response_cache *cache, response_cacheable_t cacheable);
+
+// Copies the cached response to req into resp, patched with the transaction id
+// of req. Returns its length, or 0 if it isn't cached.
+int response_cache_lookup(struct response_cache *cache, uint32_t generation,
+                          const uint8_t *req, uint16_t req_len, uint8_t *resp, uint16_t resp_size);
+
+// Caches resp as the response to req, replacing the least recently used entry
+void response_cache_store(struct response_cache *cache, uint32_t generation,
+                          const uint8_t *req, uint16_t req_len, const uint8_t *resp, uint16_t resp_len);
+
+#endif /* RESPONSE_CACHE_HEADER_H */
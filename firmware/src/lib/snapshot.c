@@ -0,0 +1,216 @@
+#include "snapshot.h"
+#include "history.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(snapshot, LOG_LEVEL_DBG);
+
+#define DATE_TIME_DIGITS 12
+#define DATE_TIME_LIMIT 1000000000000LL
+
+// Meter registers only grow, and change little between snapshots
+bool snapshot_is_counter(enum Item item) {
+    enum Format format = data_definition_table[item].format;
+    return format == DOUBLE_LONG_UNSIGNED_8_3 || format == DOUBLE_LONG_SIGNED_8_3;
+}
+
+// YYMMDDhhmmssX as the 12 digit number times 2, plus 1 for summer time
+static int date_time_value(const uint8_t *date_time, int64_t *value) {
+    int64_t number = 0;
+    for (int i = 0 ; i < DATE_TIME_DIGITS ; i++) {
+        if (date_time[i] < '0' || date_time[i] > '9') {
+            return -EINVAL;
+        }
+        number = number * 10 + date_time[i] - '0';
+    }
+    if (date_time[DATE_TIME_DIGITS] != 'S' && date_time[DATE_TIME_DIGITS] != 'W') {
+        return -EINVAL;
+    }
+    *value = number * 2 + (date_time[DATE_TIME_DIGITS] == 'S');
+    return 0;
+}
+
+static int set_date_time(uint8_t *date_time, int64_t value) {
+    if (value < 0 || value / 2 >= DATE_TIME_LIMIT) {
+        return -EINVAL;
+    }
+    date_time[DATE_TIME_DIGITS] = (value & 1) ? 'S' : 'W';
+    date_time[DATE_TIME_DIGITS + 1] = '\0';
+    value /= 2;
+    for (int i = DATE_TIME_DIGITS - 1 ; i >= 0 ; i--) {
+        date_time[i] = '0' + value % 10;
+        value /= 10;
+    }
+    return 0;
+}
+
+void snapshot_base_init(struct snapshot_base *base, uint32_t generation) {
+    base->generation = generation;
+    base->items = 0;
+}
+
+void snapshot_base_put(struct snapshot_base *base, struct data_item *data) {
+    int64_t value;
+    if (snapshot_is_counter(data->item) && data_item_numeric_value(data, &value) == 0) {
+        base->values[data->item] = value;
+        base->items |= BIT64(data->item);
+    }
+}
+
+void snapshot_writer_init(struct snapshot_writer *writer, uint8_t *buf, size_t size, uint32_t generation,
+                          const struct snapshot_base *base, uint8_t flags, int64_t now) {
+    writer->buf = buf;
+    writer->size = size;
+    writer->flags = (flags & SNAPSHOT_FLAG_AGES) | (base != NULL ? SNAPSHOT_FLAG_DELTA : 0);
+    writer->len = base != NULL ? SNAPSHOT_DELTA_HEADER_LENGTH : SNAPSHOT_HEADER_LENGTH;
+    writer->count = 0;
+    writer->generation = generation;
+    writer->base = base;
+    writer->now = now;
+}
+
+int snapshot_put_item(struct snapshot_writer *writer, struct value_store *store, enum Item item) {
+    struct value_store_row *row = &store->rows[item];
+    uint8_t record[SNAPSHOT_MAX_RECORD_LENGTH];
+    int len = 1;
+    int64_t value;
+
+    if (row->last_updated == NEVER_UPDATED) {
+        return -EINVAL;
+    }
+    if (data_definition_table[item].format == DATE_TIME_STRING) {
+        if (date_time_value(row->data.value.date_time, &value) < 0) {
+            return -EINVAL;
+        }
+    } else if (data_item_numeric_value(&row->data, &value) < 0) {
+        return -EINVAL;
+    }
+
+    record[0] = item;
+    if (writer->base != NULL && (writer->base->items & BIT64(item))) {
+        record[0] |= SNAPSHOT_RECORD_DELTA;
+        value -= writer->base->values[item];
+    }
+    len += zigzag_varint_encode(value, &record[len]);
+    if (writer->flags & SNAPSHOT_FLAG_AGES) {
+        len += zigzag_varint_encode(MAX(writer->now - row->last_updated, 0), &record[len]);
+    }
+
+    if (writer->len + len > writer->size) {
+        return -ENOMEM;
+    }
+    memcpy(&writer->buf[writer->len], record, len);
+    writer->len += len;
+    writer->count++;
+    return 0;
+}
+
+int snapshot_writer_finish(struct snapshot_writer *writer, uint8_t flags) {
+    size_t header = writer->base != NULL ? SNAPSHOT_DELTA_HEADER_LENGTH : SNAPSHOT_HEADER_LENGTH;
+    if (writer->size < header) {
+        return -ENOMEM;
+    }
+    writer->buf[0] = SNAPSHOT_MAGIC;
+    writer->buf[1] = SNAPSHOT_VERSION;
+    writer->buf[2] = writer->flags | (flags & (SNAPSHOT_FLAG_FULL | SNAPSHOT_FLAG_MORE));
+    writer->buf[3] = writer->count;
+    sys_put_be32(writer->generation, &writer->buf[4]);
+    if (writer->base != NULL) {
+        sys_put_be32(writer->base->generation, &writer->buf[8]);
+    }
+    return writer->len;
+}
+
+int snapshot_encode(struct value_store *store, uint64_t items, const struct snapshot_base *base,
+                    uint8_t flags, int64_t now, uint8_t *buf, size_t size) {
+    struct snapshot_writer writer;
+
+    snapshot_writer_init(&writer, buf, size, store->generation, base, flags, now);
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if ((items & BIT64(i)) && snapshot_put_item(&writer, store, i) == -ENOMEM) {
+            return -ENOMEM;
+        }
+    }
+    return snapshot_writer_finish(&writer, flags);
+}
+
+static int decode_record(const uint8_t *buf, size_t len, const struct snapshot_base *base, struct snapshot *out) {
+    enum Item item = buf[0] & SNAPSHOT_RECORD_ITEM_MASK;
+    bool delta = buf[0] & SNAPSHOT_RECORD_DELTA;
+    int64_t value, age = 0;
+    int pos = 1;
+    int ret;
+
+    if (item >= _ITEM_COUNT || (delta && !(out->flags & SNAPSHOT_FLAG_DELTA))) {
+        return -EINVAL;
+    }
+    ret = zigzag_varint_decode(&buf[pos], len - pos, &value);
+    if (ret < 0) {
+        return -EINVAL;
+    }
+    pos += ret;
+    if (out->flags & SNAPSHOT_FLAG_AGES) {
+        ret = zigzag_varint_decode(&buf[pos], len - pos, &age);
+        if (ret < 0) {
+            return -EINVAL;
+        }
+        pos += ret;
+    }
+
+    if (delta) {
+        if (base == NULL || base->generation != out->base_generation || !(base->items & BIT64(item))) {
+            out->unresolved |= BIT64(item);
+            return pos;
+        }
+        value += base->values[item];
+    }
+
+    struct value_store_row *row = &out->rows[item];
+    row->data.item = item;
+    row->last_updated = -age;
+    if (data_definition_table[item].format == DATE_TIME_STRING) {
+        ret = set_date_time(row->data.value.date_time, value);
+    } else {
+        ret = data_item_set_numeric_value(&row->data, value);
+    }
+    if (ret < 0) {
+        return -EINVAL;
+    }
+    out->items |= BIT64(item);
+    return pos;
+}
+
+int snapshot_decode(const uint8_t *buf, size_t len, const struct snapshot_base *base, struct snapshot *out) {
+    size_t pos = SNAPSHOT_HEADER_LENGTH;
+
+    if (len < SNAPSHOT_HEADER_LENGTH || buf[0] != SNAPSHOT_MAGIC) {
+        return -EINVAL;
+    }
+    if (buf[1] != SNAPSHOT_VERSION) {
+        return -ENOTSUP;
+    }
+    memset(out, 0, sizeof(*out));
+    out->flags = buf[2];
+    out->generation = sys_get_be32(&buf[4]);
+    if (out->flags & SNAPSHOT_FLAG_DELTA) {
+        if (len < SNAPSHOT_DELTA_HEADER_LENGTH) {
+            return -EINVAL;
+        }
+        out->base_generation = sys_get_be32(&buf[8]);
+        pos = SNAPSHOT_DELTA_HEADER_LENGTH;
+    }
+
+    for (int i = 0 ; i < buf[3] ; i++) {
+        if (pos >= len) {
+            return -EINVAL;
+        }
+        int ret = decode_record(&buf[pos], len - pos, base, out);
+        if (ret < 0) {
+            return ret;
+        }
+        pos += ret;
+    }
+    return pos == len ? 0 : -EINVAL;
+}
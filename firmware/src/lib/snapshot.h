@@ -0,0 +1,83 @@
+#ifndef SNAPSHOT_HEADER_H
+#define SNAPSHOT_HEADER_H
+
+#include "value_store.h"
+
+#include <zephyr/types.h>
+
+// Versioned binary encoding of the items of a store: magic, version, flags,
+// record count and the uint32 generation of the store, followed by the uint32
+// generation of the base with SNAPSHOT_FLAG_DELTA, then one record per item
+// holding a value. A record is the item number, with SNAPSHOT_RECORD_DELTA if
+// its value is relative to the base, and the value as zigzag varint, followed
+// by the age in ms as zigzag varint with SNAPSHOT_FLAG_AGES. Meter time is
+// encoded as YYMMDDhhmmss * 2 + 1 for summer time.
+#define SNAPSHOT_MAGIC 'S'
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_LENGTH 8
+#define SNAPSHOT_DELTA_HEADER_LENGTH 12
+// Item number, a 10 byte varint value and a 10 byte varint age
+#define SNAPSHOT_MAX_RECORD_LENGTH 21
+#define SNAPSHOT_MAX_LENGTH (SNAPSHOT_DELTA_HEADER_LENGTH + _ITEM_COUNT * SNAPSHOT_MAX_RECORD_LENGTH)
+
+#define SNAPSHOT_FLAG_FULL BIT(0)  // Every fresh item is included, changed or not
+#define SNAPSHOT_FLAG_MORE BIT(1)  // More snapshots of the same generation follow
+#define SNAPSHOT_FLAG_DELTA BIT(2) // Counters may be relative to the base
+#define SNAPSHOT_FLAG_AGES BIT(3)  // Records end with the age of the item
+
+#define SNAPSHOT_RECORD_DELTA BIT(7)
+#define SNAPSHOT_RECORD_ITEM_MASK 0x3f
+
+// Counter values of an earlier full snapshot, held by encoder and decoder
+struct snapshot_base {
+    uint32_t generation;
+    uint64_t items;            // Items with a value in values
+    int64_t values[_ITEM_COUNT];
+};
+
+struct snapshot_writer {
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    uint8_t flags;
+    uint8_t count;
+    uint32_t generation;
+    const struct snapshot_base *base;
+    int64_t now;               // Ages are relative to it
+};
+
+struct snapshot {
+    uint32_t generation;
+    uint32_t base_generation;
+    uint8_t flags;
+    uint64_t items;            // Items decoded into rows
+    uint64_t unresolved;       // Items relative to a base not held by the decoder
+    // last_updated is minus the age with SNAPSHOT_FLAG_AGES, 0 otherwise
+    struct value_store_row rows[_ITEM_COUNT];
+};
+
+bool snapshot_is_counter(enum Item item);
+
+void snapshot_base_init(struct snapshot_base *base, uint32_t generation);
+// Records the value of a counter, other items are ignored
+void snapshot_base_put(struct snapshot_base *base, struct data_item *data);
+
+// Counters held by base, if not NULL, are written relative to it. flags may
+// hold SNAPSHOT_FLAG_AGES.
+void snapshot_writer_init(struct snapshot_writer *writer, uint8_t *buf, size_t size, uint32_t generation,
+                          const struct snapshot_base *base, uint8_t flags, int64_t now);
+// Appends the row of an item holding a value. Returns 0, -ENOMEM if it does
+// not fit, leaving the snapshot as it was, or -EINVAL if it holds no value.
+int snapshot_put_item(struct snapshot_writer *writer, struct value_store *store, enum Item item);
+// Writes the header, with flags added. Returns the length of the snapshot.
+int snapshot_writer_finish(struct snapshot_writer *writer, uint8_t flags);
+
+// Encodes the items of the mask holding a value into one snapshot. Returns
+// its length, or -ENOMEM.
+int snapshot_encode(struct value_store *store, uint64_t items, const struct snapshot_base *base,
+                    uint8_t flags, int64_t now, uint8_t *buf, size_t size);
+// Decodes a snapshot, resolving counters against base, which may be NULL.
+// Returns 0, -EINVAL if malformed or -ENOTSUP for another version.
+int snapshot_decode(const uint8_t *buf, size_t len, const struct snapshot_base *base, struct snapshot *out);
+
+#endif /* SNAPSHOT_HEADER_H */
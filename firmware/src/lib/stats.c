@@ -0,0 +1,13 @@
+#include "stats.h"
+
+#include <zephyr/sys/atomic.h>
+
+static atomic_t stats[__NUM_STATS];
+
+void stats_increment(enum stat stat) {
+    atomic_inc(&stats[stat]);
+}
+
+uint32_t stats_get(enum stat stat) {
+    return atomic_get(&stats[stat]);
+}
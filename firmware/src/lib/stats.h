@@ -0,0 +1,22 @@
+#ifndef STATS_HEADER_H
+#define STATS_HEADER_H
+
+#include <zephyr/types.h>
+
+// Health counters of the telegram pipeline and the Modbus server
+enum stat {
+    STAT_FRAMES,               // Telegram frames received
+    STAT_FRAMES_INCOMPLETE,    // Partial frames discarded on a read timeout
+    STAT_PARSE_ERRORS,         // Frames that could not be parsed
+    STAT_TELEGRAMS_DISCARDED,  // Parsed telegrams replaced by a newer one before being applied
+    STAT_MODBUS_REQUESTS,
+    STAT_MODBUS_CACHE_HITS,
+    STAT_REPLIES_UNFRAGMENTED, // Replies fitting the frame budget of their transport
+    STAT_REPLIES_FRAGMENTED,
+    __NUM_STATS,
+};
+
+void stats_increment(enum stat stat);
+uint32_t stats_get(enum stat stat);
+
+#endif /* STATS_HEADER_H */
@@ -0,0 +1,116 @@
+#include "sunspec.h"
+#include "modbus_pdu.h"
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+// Values of points that are not implemented, or items that are stale
+#define NOT_IMPLEMENTED_INT16 0x8000
+#define NOT_IMPLEMENTED_ACC32 0
+
+static void put_string(uint8_t *block, uint16_t offset, uint16_t registers, const char *value) {
+    uint8_t *dst = &block[offset * 2];
+    memset(dst, 0, registers * 2);
+    if (value != NULL) {
+        memcpy(dst, value, MIN(strlen(value), registers * 2));
+    }
+}
+
+static bool numeric_value(struct value_store *store, enum Item item, int64_t *value) {
+    return value_store_is_fresh(store, item) &&
+           data_item_numeric_value(&store->rows[item].data, value) == 0;
+}
+
+// int16 value with the smallest scale factor that fits it
+static void put_scaled(uint8_t *meter, uint16_t point, uint16_t sf_point, bool valid, int64_t value) {
+    int16_t sf = 0;
+    if (!valid) {
+        sys_put_be16(NOT_IMPLEMENTED_INT16, &meter[point * 2]);
+        sys_put_be16(NOT_IMPLEMENTED_INT16, &meter[sf_point * 2]);
+        return;
+    }
+    while (value > INT16_MAX || value < -INT16_MAX) {
+        value /= 10;
+        sf++;
+    }
+    sys_put_be16((int16_t) value, &meter[point * 2]);
+    sys_put_be16(sf, &meter[sf_point * 2]);
+}
+
+static void put_acc32(uint8_t *meter, uint16_t point, bool valid, int64_t value) {
+    sys_put_be32(valid ? (uint32_t) value : NOT_IMPLEMENTED_ACC32, &meter[point * 2]);
+}
+
+static void build_meter(struct value_store *store, uint8_t *meter) {
+    int64_t in, out, energy;
+    bool valid;
+
+    // Unimplemented int16 points are 0x8000, acc32 points 0
+    for (int i = 0 ; i < SUNSPEC_TOT_WH_EXP ; i++) {
+        sys_put_be16(NOT_IMPLEMENTED_INT16, &meter[i * 2]);
+    }
+    memset(&meter[SUNSPEC_TOT_WH_EXP * 2], 0, (SUNSPEC_METER_LENGTH - SUNSPEC_TOT_WH_EXP) * 2);
+    sys_put_be16(NOT_IMPLEMENTED_INT16, &meter[SUNSPEC_TOT_WH_SF * 2]);
+    sys_put_be16(NOT_IMPLEMENTED_INT16, &meter[SUNSPEC_TOT_VAH_SF * 2]);
+    sys_put_be16(NOT_IMPLEMENTED_INT16, &meter[SUNSPEC_TOT_VARH_SF * 2]);
+
+    // Power in W and var, positive when importing
+    valid = numeric_value(store, ACTIVE_ENERGY_IN, &in) && numeric_value(store, ACTIVE_ENERGY_OUT, &out);
+    put_scaled(meter, SUNSPEC_W, SUNSPEC_W_SF, valid, in - out);
+    valid = numeric_value(store, REACTIVE_ENERGY_IN, &in) && numeric_value(store, REACTIVE_ENERGY_OUT, &out);
+    put_scaled(meter, SUNSPEC_VAR, SUNSPEC_VAR_SF, valid, in - out);
+
+    // Energy counters in Wh and varh
+    valid = numeric_value(store, METER_ACTIVE_ENERGY_OUT, &energy);
+    put_acc32(meter, SUNSPEC_TOT_WH_EXP, valid, energy);
+    valid = numeric_value(store, METER_ACTIVE_ENERGY_IN, &energy);
+    put_acc32(meter, SUNSPEC_TOT_WH_IMP, valid, energy);
+    sys_put_be16(0, &meter[SUNSPEC_TOT_WH_SF * 2]);
+
+    // The meter only counts positive and negative reactive energy, not quadrants
+    valid = numeric_value(store, METER_REACTIVE_ENERGY_IN, &energy);
+    put_acc32(meter, SUNSPEC_TOT_VARH_IMP_Q1, valid, energy);
+    valid = numeric_value(store, METER_REACTIVE_ENERGY_OUT, &energy);
+    put_acc32(meter, SUNSPEC_TOT_VARH_EXP_Q4, valid, energy);
+    sys_put_be16(0, &meter[SUNSPEC_TOT_VARH_SF * 2]);
+
+    sys_put_be32(0, &meter[SUNSPEC_EVT * 2]);
+}
+
+int sunspec_read(struct value_store *store, const struct sunspec_identity *identity,
+                 uint16_t addr, uint16_t count, uint8_t *dst) {
+    uint8_t block[SUNSPEC_REGISTERS * 2];
+    uint8_t *pos = block;
+
+    if (addr < SUNSPEC_BASE_ADDRESS || addr + count > SUNSPEC_BASE_ADDRESS + SUNSPEC_REGISTERS) {
+        return MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+    }
+
+    memcpy(pos, "SunS", 4);
+    pos += 4;
+
+    sys_put_be16(SUNSPEC_COMMON_MODEL, &pos[0]);
+    sys_put_be16(SUNSPEC_COMMON_LENGTH, &pos[2]);
+    pos += 4;
+    put_string(pos, 0, 16, identity->manufacturer);
+    put_string(pos, 16, 16, identity->model);
+    put_string(pos, 32, 8, NULL); // Options
+    put_string(pos, 40, 8, identity->version);
+    put_string(pos, 48, 16, identity->serial);
+    sys_put_be16(identity->device_address, &pos[64 * 2]);
+    sys_put_be16(0, &pos[65 * 2]); // Pad
+    pos += SUNSPEC_COMMON_LENGTH * 2;
+
+    sys_put_be16(SUNSPEC_METER_MODEL, &pos[0]);
+    sys_put_be16(SUNSPEC_METER_LENGTH, &pos[2]);
+    pos += 4;
+    build_meter(store, pos);
+    pos += SUNSPEC_METER_LENGTH * 2;
+
+    sys_put_be16(SUNSPEC_END_MODEL, &pos[0]);
+    sys_put_be16(0, &pos[2]);
+
+    memcpy(dst, &block[(addr - SUNSPEC_BASE_ADDRESS) * 2], count * 2);
+    return 0;
+}
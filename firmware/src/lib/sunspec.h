@@ -0,0 +1,55 @@
+#ifndef SUNSPEC_HEADER_H
+#define SUNSPEC_HEADER_H
+
+#include "value_store.h"
+
+// SunSpec block: "SunS" marker, common model 1, a meter model and the end model,
+// laid out contiguously from the standard base address
+#define SUNSPEC_BASE_ADDRESS 40000
+#define SUNSPEC_COMMON_MODEL 1
+#define SUNSPEC_COMMON_LENGTH 66
+#define SUNSPEC_METER_LENGTH 105
+#define SUNSPEC_END_MODEL 0xffff
+#define SUNSPEC_REGISTERS (2 + 2 + SUNSPEC_COMMON_LENGTH + 2 + SUNSPEC_METER_LENGTH + 2)
+
+// Models 201 to 204 share their layout, only totals are known from the telegram
+#ifdef CONFIG_OPENP1_SUNSPEC_METER_MODEL
+#define SUNSPEC_METER_MODEL CONFIG_OPENP1_SUNSPEC_METER_MODEL
+#else
+#define SUNSPEC_METER_MODEL 203
+#endif
+
+// Start of the meter model, after its id and length
+#define SUNSPEC_METER_ADDRESS (SUNSPEC_BASE_ADDRESS + 2 + 2 + SUNSPEC_COMMON_LENGTH + 2)
+
+// Offsets of the implemented meter model points
+enum sunspec_meter_point {
+    SUNSPEC_W = 16,
+    SUNSPEC_W_SF = 20,
+    SUNSPEC_VAR = 26,
+    SUNSPEC_VAR_SF = 30,
+    SUNSPEC_TOT_WH_EXP = 36,
+    SUNSPEC_TOT_WH_IMP = 44,
+    SUNSPEC_TOT_WH_SF = 52,
+    SUNSPEC_TOT_VAH_SF = 69,
+    SUNSPEC_TOT_VARH_IMP_Q1 = 70,
+    SUNSPEC_TOT_VARH_EXP_Q4 = 94,
+    SUNSPEC_TOT_VARH_SF = 102,
+    SUNSPEC_EVT = 103,
+};
+
+// Common model strings, padded with NUL to their field size
+struct sunspec_identity {
+    const char *manufacturer;
+    const char *model;
+    const char *version;
+    const char *serial;
+    uint16_t device_address;
+};
+
+// Reads count registers at addr, within the SunSpec block, from an expired store.
+// Returns 0 or a MODBUS_EXC_* code.
+int sunspec_read(struct value_store *store, const struct sunspec_identity *identity,
+                 uint16_t addr, uint16_t count, uint8_t *dst);
+
+#endif /* SUNSPEC_HEADER_H */
@@ -7,25 +7,93 @@
 LOG_MODULE_REGISTER(telegram, LOG_LEVEL_DBG);
 
 
-uint16_t data_item_size(struct data_item *data_item) {
-    switch (data_definition_table[data_item->item].format) {
+uint16_t data_format_size(enum Format format) {
+    union data_value value;
+    switch (format) {
         case DOUBLE_LONG_UNSIGNED_8_3:
-            return sizeof(data_item->value.double_long_unsigned);
+            return sizeof(value.double_long_unsigned);
         case DOUBLE_LONG_UNSIGNED_4_3:
-            return sizeof(data_item->value.double_long_unsigned);
+            return sizeof(value.double_long_unsigned);
+        case DOUBLE_LONG_SIGNED_8_3:
+        case DOUBLE_LONG_SIGNED_4_3:
+            return sizeof(value.double_long_signed);
         case DATE_TIME_STRING:
-            return sizeof(data_item->value.date_time)/sizeof(uint8_t);
+            return sizeof(value.date_time)/sizeof(uint8_t);
         case LONG_SIGNED_3_1:
-            return sizeof(data_item->value.long_signed);
+            return sizeof(value.long_signed);
         case LONG_UNSIGNED_3_1:
-            return sizeof(data_item->value.long_unsigned);
+            return sizeof(value.long_unsigned);
     
     default:
-        LOG_ERR("Size of type not known: %d", data_item->item);
+        LOG_ERR("Size of format not known: %d", format);
     }
     return -1;
 }
 
+// Decimals of the value, e.g. 3 for a kWh counter in Wh
+int data_format_decimals(enum Format format) {
+    switch (format) {
+        case DOUBLE_LONG_UNSIGNED_8_3:
+        case DOUBLE_LONG_UNSIGNED_4_3:
+        case DOUBLE_LONG_SIGNED_8_3:
+        case DOUBLE_LONG_SIGNED_4_3:
+            return 3;
+        case LONG_SIGNED_3_1:
+        case LONG_UNSIGNED_3_1:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+uint16_t data_item_size(struct data_item *data_item) {
+    return data_format_size(data_definition_table[data_item->item].format);
+}
+
+// Integer value of numeric items, in the unit and scale of the definition
+int data_item_numeric_value(struct data_item *data_item, int64_t *value) {
+    switch (data_definition_table[data_item->item].format) {
+        case DOUBLE_LONG_UNSIGNED_8_3:
+        case DOUBLE_LONG_UNSIGNED_4_3:
+            *value = data_item->value.double_long_unsigned;
+            return 0;
+        case DOUBLE_LONG_SIGNED_8_3:
+        case DOUBLE_LONG_SIGNED_4_3:
+            *value = data_item->value.double_long_signed;
+            return 0;
+        case LONG_SIGNED_3_1:
+            *value = data_item->value.long_signed;
+            return 0;
+        case LONG_UNSIGNED_3_1:
+            *value = data_item->value.long_unsigned;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+// Sets a numeric item from its integer value, truncated to the format
+int data_item_set_numeric_value(struct data_item *data_item, int64_t value) {
+    switch (data_definition_table[data_item->item].format) {
+        case DOUBLE_LONG_UNSIGNED_8_3:
+        case DOUBLE_LONG_UNSIGNED_4_3:
+            data_item->value.double_long_unsigned = value;
+            return 0;
+        case DOUBLE_LONG_SIGNED_8_3:
+        case DOUBLE_LONG_SIGNED_4_3:
+            data_item->value.double_long_signed = value;
+            return 0;
+        case LONG_SIGNED_3_1:
+            data_item->value.long_signed = value;
+            return 0;
+        case LONG_UNSIGNED_3_1:
+            data_item->value.long_unsigned = value;
+            return 0;
+        default:
+            return -1;
+    }
+}
+
 struct telegram * telegram_init() {
     struct telegram *telegram = common_heap_alloc(sizeof(struct telegram));
     if (telegram == NULL) {
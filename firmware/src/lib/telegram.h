@@ -7,6 +7,7 @@
 
 union data_value {
         uint32_t double_long_unsigned;
+        int32_t double_long_signed;
         uint16_t long_unsigned;
         int16_t long_signed;
         uint8_t date_time[14];
@@ -36,7 +37,11 @@ struct telegram_data_iterator {
     struct data_list *_pos;
 };
 
+uint16_t data_format_size(enum Format format);
+int data_format_decimals(enum Format format);
 uint16_t data_item_size(struct data_item *data_item);
+int data_item_numeric_value(struct data_item *data_item, int64_t *value);
+int data_item_set_numeric_value(struct data_item *data_item, int64_t value);
 
 struct telegram * telegram_init();
 void telegram_free(struct telegram *telegram);
@@ -37,11 +37,6 @@ bool telegram_framer_check_complete(struct telegram_framer *framer) {
     return true;
 }
 
-void telegram_framer_remove_footer(struct telegram_framer *framer) {
-    net_buf_remove_mem(framer->buf, 7); // Remove footer
-    net_buf_add_u8(framer->buf, '\0');
-}
-
 struct net_buf * telegram_framer_swap_buf(struct telegram_framer *framer) {
     // Allocate next, if not available, reset and reuse this buffer.
     struct net_buf *next_buf = net_buf_alloc(&telegram_buf_pool, K_NO_WAIT);
@@ -113,7 +108,7 @@ struct net_buf * telegram_framer_push(struct telegram_framer *framer, char c) {
             return NULL;
         }
 
-        telegram_framer_remove_footer(framer);
+        // Handed on as received, checksum line included, for raw subscribers
         return telegram_framer_swap_buf(framer);
     }
 
@@ -4,7 +4,13 @@
 #include <zephyr/net/buf.h>
 
 #define MAX_TELEGRAM_SIZE 8192
+// One being framed and up to three on the way to the parser, plus the one
+// raw telegram subscribers are sent from
+#ifdef CONFIG_OPENP1_RAW_TELEGRAM
+#define TELEGRAM_BUF_POOL_SIZE 5
+#else
 #define TELEGRAM_BUF_POOL_SIZE 4
+#endif
 
 struct telegram_framer {
     struct net_buf *buf;
@@ -13,6 +19,8 @@ struct telegram_framer {
 
 struct telegram_framer * telegram_framer_init();
 
+// Returns the frame once a telegram with a valid checksum is complete, as
+// received from its header up to and including the checksum line
 struct net_buf * telegram_framer_push(struct telegram_framer *framer, char c);
 
 void telegram_framer_reset(struct telegram_framer *framer);
@@ -1,21 +1,165 @@
-
 #include "value_store.h"
 #include "openp1.h"
 #include "stdint.h"
 
 #include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(value_store, LOG_LEVEL_DBG);
+
+BUILD_ASSERT(_ITEM_COUNT <= 64, "fresh bitmap holds at most 64 items");
 
 int value_store_init(struct value_store *store) {
     for(int i = 0 ; i < _ITEM_COUNT ; i++) {
-        store->rows[i].last_updated = -1;
+        store->rows[i].last_updated = NEVER_UPDATED;
+    }
+    memset(store->registers, 0, sizeof(store->registers));
+    store->fresh = 0;
+    store->restored = 0;
+    store->generation = 0;
+    store->telegrams = 0;
+    store->last_telegram = NEVER_UPDATED;
+    store->telegram_interval = 0;
+    for(int i = 0 ; i < FIRST_VIRTUAL_ITEM ; i++) {
+        history_init(&store->history[i]);
+    }
+    demand_init(&store->demand);
+    k_mutex_init(&store->lock);
+    return derived_metrics_init(&store->derived);
+}
+
+static void encode_registers(struct data_item *data, uint16_t *registers) {
+    uint8_t *buf = (uint8_t *) registers;
+    union data_value *value = &data->value;
+    switch(data_definition_table[data->item].format) {
+        case DATE_TIME_STRING:
+            memcpy(buf, value->date_time, sizeof(value->date_time));
+            break;
+        case DOUBLE_LONG_UNSIGNED_8_3:
+        case DOUBLE_LONG_UNSIGNED_4_3:
+            sys_put_be32(value->double_long_unsigned, buf);
+            break;
+        case DOUBLE_LONG_SIGNED_8_3:
+        case DOUBLE_LONG_SIGNED_4_3:
+            sys_put_be32((uint32_t) value->double_long_signed, buf);
+            break;
+        case LONG_SIGNED_3_1:
+        case LONG_UNSIGNED_3_1:
+            sys_put_be16(value->long_unsigned, buf);
+            break;
+        default:
+            LOG_ERR("BUG: Unhandled item");
+            break;
     }
-    return 0;
 }
 
 void value_store_update(struct value_store *store, struct data_item *data) {
-    // Todo add mutex against copy
+    int64_t numeric;
+    int64_t now = k_uptime_get();
     store->rows[data->item].data = *data;
-    store->rows[data->item].last_updated = k_uptime_get();
+    store->rows[data->item].last_updated = now;
+    encode_registers(data, store->registers[data->item]);
+    store->fresh |= BIT64(data->item);
+    store->restored &= ~BIT64(data->item);
+    if (!IS_VIRTUAL_ITEM(data->item) && data_item_numeric_value(data, &numeric) == 0) {
+        history_append(&store->history[data->item], now, numeric);
+    }
+}
+
+static void update_virtual_item(struct value_store *store, enum Item item, int64_t value) {
+    struct data_item data = { .item = item };
+    data_item_set_numeric_value(&data, value);
+    value_store_update(store, &data);
+}
+
+// Rows are fresh for BEST_BEFORE_MS after an update. Rows that never received a
+// value, or were restored from before boot, are stale whatever the uptime.
+static bool is_fresh(struct value_store *store, enum Item item, int64_t now) {
+    int64_t last_updated = store->rows[item].last_updated;
+    return (store->fresh & BIT64(item)) && last_updated != NEVER_UPDATED &&
+           now <= last_updated + BEST_BEFORE_MS;
+}
+
+// Recomputes the virtual items depending on any of the updated items
+static void update_derived(struct value_store *store, uint64_t updated, int64_t now) {
+    for (int i = 0 ; i < derived_definition_count ; i++) {
+        const struct derived_definition *def = &derived_definition_table[i];
+        int64_t value, subtrahend;
+
+        if (def->aggregate == AGGREGATE_NET) {
+            if (!(updated & (BIT64(def->source) | BIT64(def->subtrahend))) ||
+                !is_fresh(store, def->source, now) || !is_fresh(store, def->subtrahend, now) ||
+                data_item_numeric_value(&store->rows[def->source].data, &value) < 0 ||
+                data_item_numeric_value(&store->rows[def->subtrahend].data, &subtrahend) < 0) {
+                continue;
+            }
+            update_virtual_item(store, def->item, value - subtrahend);
+        } else if (updated & BIT64(def->source)) {
+            if (derived_metrics_get(&store->derived, def, &value) == 0) {
+                update_virtual_item(store, def->item, value);
+            }
+        }
+    }
+}
+
+// Feeds the quarter-hour demand tracker with telegrams holding both meter time and energy
+static void update_demand(struct value_store *store, uint64_t updated) {
+    struct demand_result result;
+    if ((updated & (BIT64(DATE_TIME) | BIT64(METER_ACTIVE_ENERGY_IN))) !=
+        (BIT64(DATE_TIME) | BIT64(METER_ACTIVE_ENERGY_IN))) {
+        return;
+    }
+    int32_t power = (updated & BIT64(ACTIVE_ENERGY_IN)) ?
+                    store->rows[ACTIVE_ENERGY_IN].data.value.double_long_unsigned : -1;
+    if (demand_update(&store->demand, store->rows[DATE_TIME].data.value.date_time,
+                      store->rows[METER_ACTIVE_ENERGY_IN].data.value.double_long_unsigned,
+                      power, &result) < 0) {
+        return;
+    }
+    update_virtual_item(store, DEMAND_AVERAGE, result.average);
+    update_virtual_item(store, DEMAND_PROJECTED, result.projected);
+    if (result.peak_valid) {
+        update_virtual_item(store, DEMAND_MONTH_PEAK, result.month_peak);
+    }
+}
+
+// Smooths the time between telegrams, weighing the latest interval by 1/8. The
+// first telegram after boot has none, also when the store was restored.
+static void update_telegram_interval(struct value_store *store, int64_t now) {
+    if (store->telegrams > 0) {
+        uint32_t interval = MIN(now - store->last_telegram, UINT32_MAX);
+        if (store->telegram_interval == 0) {
+            store->telegram_interval = interval;
+        } else {
+            store->telegram_interval = ((uint64_t) store->telegram_interval * 7 + interval) / 8;
+        }
+    }
+    store->last_telegram = now;
+    store->telegrams++;
+}
+
+// Applies all items of a telegram, followed by the virtual items derived from them
+void value_store_apply(struct value_store *store, struct telegram *telegram) {
+    uint64_t updated = 0;
+    int64_t now = k_uptime_get();
+    struct data_item *data_item;
+    struct telegram_data_iterator iter;
+    value_store_lock(store);
+    telegram_item_iterator_init(telegram, &iter);
+    while (NULL != (data_item = telegram_item_iterator_next(&iter))) {
+        int64_t numeric;
+        value_store_update(store, data_item);
+        updated |= BIT64(data_item->item);
+        if (data_item_numeric_value(data_item, &numeric) == 0) {
+            derived_metrics_push(&store->derived, data_item->item, now, numeric);
+        }
+    }
+    update_derived(store, updated, now);
+    update_demand(store, updated);
+    update_telegram_interval(store, now);
+    store->generation++;
+    value_store_unlock(store);
 }
 
 struct value_store_read_result value_store_read(struct value_store *store, uint16_t item) {
@@ -25,21 +169,129 @@ struct value_store_read_result value_store_read(struct value_store *store, uint1
         return result;
     }
 
-    struct value_store_row *row = &store->rows[item];
-
-    uint64_t current_time = k_uptime_get();
-    if (current_time > row->last_updated + BEST_BEFORE_MS) {
+    if (!is_fresh(store, item, k_uptime_get())) {
         result.status = STALE;
         return result;
     }
 
-    result.data.data = row->data;
+    result.data.data = store->rows[item].data;
     result.status = OK;
     return result;
 }
 
 int value_store_copy(struct value_store *src, struct value_store *dst) {
+    value_store_lock(src);
     *dst = *src;
+    value_store_unlock(src);
+    k_mutex_init(&dst->lock);
     return 0;
 }
 
+void value_store_lock(struct value_store *store) {
+    k_mutex_lock(&store->lock, K_FOREVER);
+}
+
+void value_store_unlock(struct value_store *store) {
+    k_mutex_unlock(&store->lock);
+}
+
+// Shifts the update times of rows by delta, e.g. to or from snapshot relative time
+void value_store_rebase_rows(struct value_store_row *rows, int count, int64_t delta) {
+    for (int i = 0 ; i < count ; i++) {
+        if (rows[i].last_updated != NEVER_UPDATED) {
+            rows[i].last_updated += delta;
+        }
+    }
+}
+
+// Completes a store restored with times relative to its snapshot, now being
+// the uptime the snapshot should correspond to. Rebuilds the register image.
+// Restored values are never fresh, they are marked restored until the meter
+// sends them again, and the last telegram is taken to be the newest of them.
+void value_store_restore(struct value_store *store, int64_t now) {
+    value_store_rebase_rows(store->rows, _ITEM_COUNT, now);
+    for (int i = 0 ; i < FIRST_VIRTUAL_ITEM ; i++) {
+        history_rebase(&store->history[i], now);
+    }
+    derived_metrics_rebase(&store->derived, now);
+
+    store->fresh = 0;
+    store->restored = 0;
+    store->generation++;
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (store->rows[i].last_updated != NEVER_UPDATED) {
+            encode_registers(&store->rows[i].data, store->registers[i]);
+            store->restored |= BIT64(i);
+            if (store->last_telegram == NEVER_UPDATED || store->rows[i].last_updated > store->last_telegram) {
+                store->last_telegram = store->rows[i].last_updated;
+            }
+        }
+    }
+}
+
+uint16_t value_store_item_registers(uint16_t item) {
+    if (item >= _ITEM_COUNT) {
+        return 0;
+    }
+    return (data_format_size(data_definition_table[item].format) + 1) / 2;
+}
+
+// Clears the fresh bit of every item older than BEST_BEFORE_MS
+void value_store_expire(struct value_store *store) {
+    int64_t current_time = k_uptime_get();
+    uint64_t fresh = store->fresh;
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (!is_fresh(store, i, current_time)) {
+            fresh &= ~BIT64(i);
+        }
+    }
+    if (fresh != store->fresh) {
+        store->fresh = fresh;
+        store->generation++;
+    }
+}
+
+int64_t value_store_next_expiry(struct value_store *store) {
+    int64_t next = INT64_MAX;
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (store->fresh & BIT64(i)) {
+            next = MIN(next, store->rows[i].last_updated + BEST_BEFORE_MS + 1);
+        }
+    }
+    return next;
+}
+
+bool value_store_is_fresh(struct value_store *store, uint16_t item) {
+    return item < _ITEM_COUNT && (store->fresh & BIT64(item));
+}
+
+bool value_store_is_restored(struct value_store *store, uint16_t item) {
+    return item < _ITEM_COUNT && (store->restored & BIT64(item));
+}
+
+// Copies count big-endian registers of item, starting at offset, into dst.
+// Freshness is taken from the bitmap, see value_store_expire(). Restored
+// values are copied too, and reported as such.
+enum value_store_read_status value_store_read_registers(struct value_store *store, uint16_t item,
+                                                        uint16_t offset, uint16_t count, uint8_t *dst) {
+    if (item >= _ITEM_COUNT || offset + count > value_store_item_registers(item)) {
+        return INVALID;
+    }
+    if (!((store->fresh | store->restored) & BIT64(item))) {
+        return STALE;
+    }
+    memcpy(dst, &store->registers[item][offset], count * sizeof(uint16_t));
+    return (store->fresh & BIT64(item)) ? OK : RESTORED;
+}
+
+// Samples of item updated after since (uptime ms), oldest first
+int value_store_read_history(struct value_store *store, uint16_t item, int64_t since,
+                             struct history_sample *out, int max) {
+    if (item >= _ITEM_COUNT) {
+        return -EINVAL;
+    }
+    if (IS_VIRTUAL_ITEM(item)) {
+        return 0;
+    }
+    return history_read(&store->history[item], since, out, max);
+}
@@ -1,24 +1,55 @@
 #ifndef VALUE_STORE_H
 #define VALUE_STORE_H
 
+#include <zephyr/kernel.h>
+
 #include "telegram.h"
 #include "openp1.h"
+#include "history.h"
+#include "derived.h"
+#include "demand.h"
+
+#define BEST_BEFORE_MS (60 * 1000)
+
+// last_updated of rows that never received a value
+#define NEVER_UPDATED INT64_MIN
 
-#define BEST_BEFORE_MS 60 * 1000 
+// Largest item (DATE_TIME_STRING, 14 bytes) occupies 7 registers
+#define VALUE_STORE_MAX_ITEM_REGISTERS 7
 
 struct value_store_row {
     struct data_item data;
-	uint64_t last_updated;
+	int64_t last_updated; // Uptime in ms, negative for values restored from before boot
 };
 
 struct value_store {
     struct value_store_row rows[_ITEM_COUNT];
+    // Big-endian register image of every item, rewritten on update only
+    uint16_t registers[_ITEM_COUNT][VALUE_STORE_MAX_ITEM_REGISTERS];
+    // Bit per item, set while the item holds a value within BEST_BEFORE_MS
+    uint64_t fresh;
+    // Bit per item, set while the item holds a value restored from before boot
+    // that the meter has not sent again
+    uint64_t restored;
+    // Changes whenever the values served from the store may have changed
+    uint32_t generation;
+    uint32_t telegrams;           // Telegrams applied since boot
+    int64_t last_telegram;        // Uptime in ms, NEVER_UPDATED before the first telegram or restore
+    uint32_t telegram_interval;   // Smoothed time between telegrams in ms, 0 until known
+    // Recent samples of numeric meter items
+    struct history history[FIRST_VIRTUAL_ITEM];
+    // Aggregates behind the virtual items
+    struct derived_metrics derived;
+    struct demand_tracker demand;
+    // Held by value_store_apply, and by readers for the duration of a request
+    struct k_mutex lock;
 };
 
 enum value_store_read_status {
     OK,
     STALE,
     INVALID,
+    RESTORED, // Restored from before boot, not sent by the meter since
 };
 
 struct value_store_read_result {
@@ -31,7 +62,24 @@ struct value_store_read_result {
 
 int value_store_init(struct value_store *store);
 void value_store_update(struct value_store *store, struct data_item *data);
+void value_store_apply(struct value_store *store, struct telegram *telegram);
 struct value_store_read_result value_store_read(struct value_store *store, uint16_t item);
 int value_store_copy(struct value_store *src, struct value_store *dst);
+void value_store_lock(struct value_store *store);
+void value_store_unlock(struct value_store *store);
+void value_store_rebase_rows(struct value_store_row *rows, int count, int64_t delta);
+void value_store_restore(struct value_store *store, int64_t now);
+
+uint16_t value_store_item_registers(uint16_t item);
+void value_store_expire(struct value_store *store);
+// Uptime at which the next fresh item turns stale, INT64_MAX if none is fresh
+int64_t value_store_next_expiry(struct value_store *store);
+bool value_store_is_fresh(struct value_store *store, uint16_t item);
+bool value_store_is_restored(struct value_store *store, uint16_t item);
+enum value_store_read_status value_store_read_registers(struct value_store *store, uint16_t item,
+                                                        uint16_t offset, uint16_t count, uint8_t *dst);
+
+int value_store_read_history(struct value_store *store, uint16_t item, int64_t since,
+                             struct history_sample *out, int max);
 
-#endif /* VALUE_STORE_H */
\ No newline at end of file
+#endif /* VALUE_STORE_H */
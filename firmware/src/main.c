@@ -10,9 +10,15 @@
 #include "parser_task.h"
 #include "handler_task.h"
 #include "modbus.h"
+#include "transport.h"
 #include "tcp_log.h"
 #include "input.h"
 #include "watchdog.h"
+#include "persistence.h"
+#include "push_publisher.h"
+#include "coap_server.h"
+#include "mqtt_sn_publisher.h"
+#include "raw_telegram.h"
 
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
@@ -30,12 +36,47 @@ K_MSGQ_DEFINE(telegram_queue, sizeof(telegram_message), 1, 4);
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_DBG);
 
+// Sockets of the enabled features. TCP listeners accept one more connection
+// than they serve, to close it right away.
+#define SOCKETS (IS_ENABLED(CONFIG_OPENP1_UDP) + \
+		 COND_CODE_1(CONFIG_OPENP1_TCP, (2 + CONFIG_OPENP1_TCP_MAX_CONNECTIONS), (0)) + \
+		 IS_ENABLED(CONFIG_OPENP1_PUSH) + IS_ENABLED(CONFIG_OPENP1_COAP) + \
+		 IS_ENABLED(CONFIG_OPENP1_MQTT_SN) + \
+		 COND_CODE_1(CONFIG_OPENP1_RAW_TELEGRAM, (2 + CONFIG_OPENP1_RAW_TELEGRAM_MAX_SUBSCRIBERS), (0)) + \
+		 2 * IS_ENABLED(CONFIG_OPENP1_LOG_TCP))
+
+BUILD_ASSERT(SOCKETS <= CONFIG_POSIX_MAX_FDS, "Raise POSIX_MAX_FDS for the enabled features");
+BUILD_ASSERT(SOCKETS <= CONFIG_NET_MAX_CONTEXTS, "Raise NET_MAX_CONTEXTS for the enabled features");
+BUILD_ASSERT(SOCKETS <= CONFIG_NET_MAX_CONN, "Raise NET_MAX_CONN for the enabled features");
+
 const char HOSTNAME[] = CONFIG_OPENP1_HOSTNAME; 
 
+// Saving to NVS and encoding CoAP notifications take more than the 1 KiB
+// of the telegram handler
+#define PUBLISH_STACK_SIZE 2048
+#define PUBLISH_PRIORITY 8
+
 struct value_store value_store;
 
-void update_data_store(struct data_item *data_item) {
-	value_store_update(&value_store, data_item);
+// Publishers and persistence run on their own queue, so that slow sends never
+// hold up telegram handling. Telegrams applied while they run are published
+// together in the next round.
+K_THREAD_STACK_DEFINE(publish_stack, PUBLISH_STACK_SIZE);
+static struct k_work_q publish_queue;
+
+static void publish_work_handler(struct k_work *work) {
+	persistence_telegram_applied(&value_store);
+	push_telegram_applied(&value_store);
+	coap_telegram_applied(&value_store);
+	mqtt_sn_telegram_applied(&value_store);
+}
+
+K_WORK_DEFINE(publish_work, publish_work_handler);
+
+void apply_telegram(struct telegram *telegram) {
+	value_store_apply(&value_store, telegram);
+	modbus_telegram_applied();
+	k_work_submit_to_queue(&publish_queue, &publish_work);
 }
 
 #if CONFIG_OPENTHREAD
@@ -47,14 +88,16 @@ void on_ot_srp_client_autostart_cb(const otSockAddr *aServerSockAddr, void *aCon
 }
 
 const char INSTANCE_NAME[] = CONFIG_OPENP1_SRP_INSTANCE_NAME;
+// One service per enabled transport
+static const char *const SERVICE_LABELS[] = {
 #if CONFIG_OPENP1_UDP
-const char SERVICE_LABEL[] = "_blep1-modbus._udp";
-#elif CONFIG_OPENP1_TCP
-const char SERVICE_LABEL[] = "_blep1-modbus._tcp";
-#else
-const char SERVICE_LABEL[] = "_blep1-unknown._unknown";
+	"_blep1-modbus._udp",
 #endif
-struct otSrpClientService srp_client_service = {0};
+#if CONFIG_OPENP1_TCP
+	"_blep1-modbus._tcp",
+#endif
+};
+struct otSrpClientService srp_client_services[ARRAY_SIZE(SERVICE_LABELS)];
 
 static int service_registration() {
 	struct otInstance *otInstance = openthread_get_default_instance();
@@ -72,14 +115,16 @@ static int service_registration() {
 		LOG_ERR("Could not set host name address, error: %d", ret);
 		return -1;
 	}
-	srp_client_service.mInstanceName = INSTANCE_NAME;
-	srp_client_service.mName = SERVICE_LABEL;
-	srp_client_service.mPort = 502;
-
-	ret = otSrpClientAddService(otInstance, &srp_client_service);
-	if (ret != OT_ERROR_NONE) {
-		LOG_ERR("Could not set service, error: %d", ret);
-		return -1;
+	for (int i = 0 ; i < ARRAY_SIZE(srp_client_services) ; i++) {
+		srp_client_services[i].mInstanceName = INSTANCE_NAME;
+		srp_client_services[i].mName = SERVICE_LABELS[i];
+		srp_client_services[i].mPort = MODBUS_PORT;
+
+		ret = otSrpClientAddService(otInstance, &srp_client_services[i]);
+		if (ret != OT_ERROR_NONE) {
+			LOG_ERR("Could not set service %s, error: %d", SERVICE_LABELS[i], ret);
+			return -1;
+		}
 	}
 	otSrpClientEnableAutoStartMode(otInstance, &on_ot_srp_client_autostart_cb, NULL);
 	LOG_INF("Service discovery setup done");
@@ -133,7 +178,23 @@ void main(void) {
 		goto fail;
 	}
 
-	err = handler_task_init(&telegram_queue, &update_data_store);
+	err = value_store_init(&value_store);
+	if (err < 0) {
+		LOG_ERR("Could not init value store (err %d)", err);
+		goto fail;
+	}
+
+	// Without persistence the store starts empty, and is not saved
+	err = persistence_init(&value_store);
+	if (err < 0) {
+		LOG_ERR("Could not restore value store (err %d), starting empty", err);
+	}
+
+	k_work_queue_start(&publish_queue, publish_stack, K_THREAD_STACK_SIZEOF(publish_stack),
+			   PUBLISH_PRIORITY, NULL);
+	k_thread_name_set(&publish_queue.thread, "publish");
+
+	err = handler_task_init(&telegram_queue, &apply_telegram);
 	if (err < 0) {
 		LOG_ERR("Could not init handler task (err %d)", err);
 		goto fail;
@@ -145,6 +206,30 @@ void main(void) {
 		goto fail;
 	}
 
+	err = push_publisher_init();
+	if (err < 0) {
+		LOG_ERR("Could not initialize push publisher (err %d)", err);
+		goto fail;
+	}
+
+	err = coap_server_init(&value_store);
+	if (err < 0) {
+		LOG_ERR("Could not initialize CoAP server (err %d)", err);
+		goto fail;
+	}
+
+	err = mqtt_sn_publisher_init();
+	if (err < 0) {
+		LOG_ERR("Could not initialize MQTT-SN publisher (err %d)", err);
+		goto fail;
+	}
+
+	err = raw_telegram_server_init();
+	if (err < 0) {
+		LOG_ERR("Could not initialize raw telegram server (err %d)", err);
+		goto fail;
+	}
+
 #if CONFIG_OPENP1_LOG_TCP
 	err = tcp_log_server_start();
 	if (err < 0) {
@@ -1,19 +1,29 @@
-
 #include "modbus.h"
 #include "lib/value_store.h"
 #include "lib/openp1.h"
+#include "lib/modbus_pdu.h"
+#include "lib/register_map.h"
+#include "lib/response_cache.h"
+#include "lib/stats.h"
+#include "modbus_buffer.h"
+#include "transport.h"
 #include "udp.h"
 #include "tcp.h"
+#include "rtu.h"
 #include "watchdog.h"
 #include "state_indicator.h"
 
 #include <stdint.h>
-#include <zephyr/modbus/modbus.h>
+#include <zephyr/logging/log.h>
 #include <sys/types.h>
 
 LOG_MODULE_REGISTER(modbus_server, LOG_LEVEL_DBG);
 
-K_SEM_DEFINE(response_ready, 0, 1);
+#define UNIT_ID 1
+#define MAX_LONG_POLLS 4
+#define LONG_POLL_MAX_TIMEOUT_S 30
+#define LONG_POLL_STACK_SIZE 2048
+#define LONG_POLL_PRIORITY 8
 
 static void modbus_activity_timer_expiry(struct k_timer *timer) {
 	state_indicator_set_state(CONNECTED); // Not necessarily true, but link monitor will watch further
@@ -27,215 +37,285 @@ static void modbus_activity_notify() {
 	watchdog_feed(MODBUS_READ);
 }
  
-static int server_iface = -1;
 static struct value_store *value_store;
-static struct value_store value_store_snapshot;
-
-static uint16_t read_word(struct data_item *data_item, uint16_t offset) {
-	uint8_t buf[14]; // TODO max length should be defined somewhere.
-    union data_value *value = &data_item->value;
-	switch(data_definition_table[data_item->item].format) {
-        case DATE_TIME_STRING:
-			memcpy(buf, value->date_time, sizeof(value->date_time));
-			break;
-        case DOUBLE_LONG_UNSIGNED_8_3:
-        case DOUBLE_LONG_UNSIGNED_4_3:
-			sys_put_be32(value->double_long_unsigned, buf);
-			break;
-        case LONG_SIGNED_3_1:
-        case LONG_UNSIGNED_3_1:
-			// Shouldn't be needed, but let's keep it for consistency and to avoid any byte ordering bugs..
-			sys_put_be16(value->long_unsigned, buf);
-			break;
-		default:
-			LOG_ERR("BUG: Unhandled item");
-			return 0;
-	}
-	return sys_get_be16(&buf[offset * 2]);
-}
+// Shared by all transports, only used with the store locked
+static struct response_cache response_cache;
+
+// State of one request, on the stack of the transport thread serving it
+struct request_context {
+	struct value_store *store;
+	int64_t now;
+	bool may_defer;
+};
 
-static int input_reg_rd(uint16_t addr, uint16_t *reg) {
+// A long poll waiting for the next generation of the store
+struct long_poll {
+	bool active;
+	uint32_t generation;
+	int64_t deadline;
+	uint16_t len;
+	uint8_t req[MODBUS_MBAP_LENGTH + MODBUS_LONG_POLL_REQUEST_LENGTH];
+	// Answered through the transport it came from
+	struct transport_request client;
+};
 
-	if (addr < 0x0800) {
-		LOG_WRN("Trying to read non-implemented system registers");
-		return -1;
-	} 
-
-	uint16_t value_addr = addr - DATA_BASE_ADDRESS;
-	uint16_t item = value_addr / 32;
-	uint16_t item_offset = value_addr % 32;
-
-	struct value_store_read_result read_result = value_store_read(&value_store_snapshot, item);
-
-	switch (read_result.status) {
-		case INVALID:
-			LOG_WRN("Read failure; invalid value");
-			return -1; 
-		case STALE:
-			LOG_INF("Read failure; stale value");
-			return -1;
-		case OK:
-			break;
-		default:
-			LOG_ERR("Read failure: unknown status");
-			return -1;
-	}
+static struct long_poll long_polls[MAX_LONG_POLLS];
+K_MUTEX_DEFINE(long_poll_lock);
 
-	struct data_item *data_item = &read_result.data.data;
-	uint16_t size = data_item_size(data_item);
+// Long polls are answered from their own queue, so that sending a reply never
+// holds up the system work queue, with a reply buffer only used by it
+K_THREAD_STACK_DEFINE(long_poll_stack, LONG_POLL_STACK_SIZE);
+static struct k_work_q long_poll_queue;
+static uint8_t long_poll_reply[MODBUS_BUFFER_SIZE];
 
-	if (item_offset > (size-1) /2 ) {
-		LOG_ERR("Read failure: invalid offset");
-		return -1;
-	}
+static void wake_long_polls(void);
 
-	uint16_t value = read_word(data_item, item_offset);
-	LOG_INF("Modbus read input register, 0x%x = %d", addr, value);
-	*reg = value;
-	return 0;
+static int read_input_registers(void *ctx, uint16_t addr, uint16_t count, uint8_t *dst) {
+	struct request_context *request = ctx;
+
+	LOG_INF("Modbus read registers, 0x%x, count %d", addr, count);
+	return register_map_read_input(request->store, request->now, addr, count, dst);
 }
 
-static struct modbus_adu rx_adu;
-static struct modbus_adu tx_adu;
-
-static int respond(const int iface, const struct modbus_adu *adu, void *user_data) {
-	LOG_INF("Server raw callback from interface %d", iface);
-	if (SEND_BUFFER_SIZE < adu->length + MODBUS_MBAP_AND_FC_LENGTH) {
-		// TODO set better exception type
-		LOG_WRN("Response too large");
-		modbus_raw_set_server_failure(&tx_adu);
-		k_sem_give(&response_ready);
-		return 0;
-	}
+// Long polls wait for values from the meter, restored values read as stale
+static int read_fresh_input_registers(void *ctx, uint16_t addr, uint16_t count, uint8_t *dst) {
+	struct request_context *request = ctx;
+
+	LOG_INF("Modbus long poll registers, 0x%x, count %d", addr, count);
+	return register_map_read_fresh_input(request->store, request->now, addr, count, dst);
+}
 
-	tx_adu.trans_id = adu->trans_id;
-	tx_adu.proto_id = adu->proto_id;
-	tx_adu.length = adu->length;
-	tx_adu.unit_id = adu->unit_id;
-	tx_adu.fc = adu->fc;
-	memcpy(tx_adu.data, adu->data, adu->length);
-	LOG_HEXDUMP_INF(tx_adu.data, tx_adu.length, "resp");
-	k_sem_give(&response_ready);
+static int read_input_registers_handler(void *ctx, const uint8_t *req, uint16_t req_len,
+										uint8_t *resp, uint16_t resp_size) {
+	return modbus_pdu_read_registers(req, req_len, resp, resp_size, read_input_registers, ctx);
+}
 
-	return 0;
+static int long_poll_handler(void *ctx, const uint8_t *req, uint16_t req_len,
+							 uint8_t *resp, uint16_t resp_size) {
+	struct request_context *request = ctx;
+
+	return modbus_pdu_long_poll(req, req_len, resp, resp_size, request->store->generation,
+								request->may_defer, read_fresh_input_registers, ctx);
 }
 
-static struct modbus_user_callbacks muc = {
-    .input_reg_rd = input_reg_rd,
+// Holding registers mirror the input registers, SunSpec clients read with either
+static const struct modbus_fc_entry fc_table[] = {
+	{ MODBUS_FC_READ_HOLDING_REGISTERS, read_input_registers_handler },
+	{ MODBUS_FC_READ_INPUT_REGISTERS, read_input_registers_handler },
+	{ MODBUS_FC_LONG_POLL, long_poll_handler },
 };
 
-const static struct modbus_iface_param server_param = {
-	.mode = MODBUS_MODE_RAW,
-	.server = {
-		.user_cb = &muc,
-		.unit_id = 1,
-	},
-	.rawcb.raw_tx_cb = respond,
-	.rawcb.user_data = NULL
+static const struct modbus_pdu_engine engine = {
+	.table = fc_table,
+	.table_len = ARRAY_SIZE(fc_table),
+	.unit_id = UNIT_ID,
 };
 
-static int send_reply(int socket) {
-	int ret;
-	uint8_t tx_buf[SEND_BUFFER_SIZE];
-	modbus_raw_put_header(&tx_adu, tx_buf);
-	// Size is checked earlier
-	memcpy(&tx_buf[MODBUS_MBAP_AND_FC_LENGTH], tx_adu.data, tx_adu.length);
-
-	#if CONFIG_OPENP1_UDP
-	ret = udp_server_send(tx_buf, MODBUS_MBAP_AND_FC_LENGTH + tx_adu.length);
-	#elif CONFIG_OPENP1_TCP
-	ret = tcp_server_send(socket, tx_buf, MODBUS_MBAP_AND_FC_LENGTH + tx_adu.length);
-	#else
-	LOG_ERR("Unknown transport");
-	ret = -1;
-	#endif
+#if CONFIG_OPENP1_SUNSPEC
+static const struct sunspec_identity sunspec_identity = {
+	.manufacturer = "OpenP1",
+	.model = "blep1",
+	.serial = CONFIG_OPENP1_HOSTNAME,
+	.device_address = UNIT_ID,
+};
+#endif
 
-	if (ret == 0) {
+// Decodes one ADU from req and encodes the reply straight into resp. The store is
+// locked only while registers are copied, not while sending. Identical reads
+// between telegrams are answered from the response cache. Requests still take
+// turns on the store lock: every one may expire items, which writes the store,
+// and the cache is shared.
+static int process_request(const uint8_t *req, uint16_t req_len, uint8_t *resp, uint16_t resp_size,
+						   bool may_defer) {
+	struct request_context ctx = {
+		.store = value_store,
+		.now = k_uptime_get(),
+		.may_defer = may_defer,
+	};
+
+	value_store_lock(ctx.store);
+	uint32_t generation = ctx.store->generation;
+	value_store_expire(ctx.store);
+	if (ctx.store->generation != generation) {
+		// Items turning stale are a new generation for long polls too
+		wake_long_polls();
+	}
+	stats_increment(STAT_MODBUS_REQUESTS);
+	int len = response_cache_lookup(&response_cache, ctx.store->generation, req, req_len, resp, resp_size);
+	if (len > 0) {
+		stats_increment(STAT_MODBUS_CACHE_HITS);
+	} else {
+		len = modbus_pdu_process(&engine, &ctx, req, req_len, resp, resp_size);
+		if (len > 0) {
+			response_cache_store(&response_cache, ctx.store->generation, req, req_len, resp, len);
+		}
+	}
+	value_store_unlock(ctx.store);
+
+	if (len == MODBUS_PDU_DEFERRED) {
+		return len;
+	} else if (len < 0) {
+		LOG_WRN("Received malformed ADU");
+	} else if (len > 0) {
+		LOG_HEXDUMP_DBG(resp, len, "resp");
 		modbus_activity_notify();
 	}
-
-	return ret;
-
+	return len;
 }
 
-#if CONFIG_OPENP1_UDP
-static int on_message_received(struct request *request) {
-#else
-static int on_message_received(struct tcp_request *request) {
-#endif
-	// Read header
-	if (request->len < MODBUS_MBAP_AND_FC_LENGTH) {
-		LOG_WRN("Received incomplete header");
-		return -1;
+static void answer_long_poll(struct long_poll *poll) {
+	int len = process_request(poll->req, poll->len, long_poll_reply, sizeof(long_poll_reply), false);
+	if (len > 0 && poll->client.transport->reply(&poll->client, long_poll_reply, len) < 0) {
+		LOG_WRN("Failed to answer long poll on %s", poll->client.transport->name);
 	}
+}
 
-	modbus_raw_get_header(&rx_adu, request->recv_buffer);
-	LOG_HEXDUMP_DBG(request->recv_buffer, sizeof(MODBUS_MBAP_AND_FC_LENGTH), "h:>");
+// Answers the long polls that saw a new generation, from a telegram or items
+// turning stale, or timed out. Waits until the next of those. Each is taken
+// out of its slot first, so that no lock is held while its reply is sent.
+static void long_poll_work_handler(struct k_work *work) {
+	struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+	int64_t now = k_uptime_get();
+	int64_t next = INT64_MAX;
+	int64_t expiry;
+	uint32_t generation;
+	bool waiting = false;
+
+	// Items turning stale change the generation, even without a telegram
+	value_store_lock(value_store);
+	value_store_expire(value_store);
+	generation = value_store->generation;
+	expiry = value_store_next_expiry(value_store);
+	value_store_unlock(value_store);
+
+	for (int i = 0 ; i < MAX_LONG_POLLS ; i++) {
+		struct long_poll *poll = &long_polls[i];
+		struct long_poll due;
+		bool answer = false;
+
+		k_mutex_lock(&long_poll_lock, K_FOREVER);
+		if (poll->active && poll->generation == generation && now < poll->deadline) {
+			next = MIN(next, poll->deadline);
+			waiting = true;
+		} else if (poll->active) {
+			due = *poll;
+			poll->active = false;
+			answer = true;
+		}
+		k_mutex_unlock(&long_poll_lock);
+
+		if (answer) {
+			answer_long_poll(&due);
+		}
+	}
 
-	if (request->len < MODBUS_MBAP_AND_FC_LENGTH + rx_adu.length) {
-		LOG_WRN("Received incomplete ADU");
-		return -1;
+	if (waiting) {
+		next = MIN(next, expiry);
+		k_work_reschedule_for_queue(&long_poll_queue, dwork, K_MSEC(MAX(next - now, 0)));
 	}
+}
 
-	memcpy(rx_adu.data, &request->recv_buffer[MODBUS_MBAP_AND_FC_LENGTH], rx_adu.length);
+K_WORK_DELAYABLE_DEFINE(long_poll_work, long_poll_work_handler);
+
+static void wake_long_polls(void) {
+	k_work_reschedule_for_queue(&long_poll_queue, &long_poll_work, K_NO_WAIT);
+}
 
-	// Take a snapshot of the value_store
-	value_store_copy(value_store, &value_store_snapshot);
+// Parks a deferred long poll until the next generation or its timeout. Returns
+// false if all slots are taken.
+static bool park_long_poll(const uint8_t *req, uint16_t req_len, const struct transport_request *client) {
+	struct modbus_long_poll parsed;
+	bool parked = false;
 
-	if (modbus_raw_submit_rx(server_iface, &rx_adu)) {
-		LOG_ERR("Failed to submit raw ADU");
-		return -EIO;
+	if (req_len > sizeof(long_polls[0].req) ||
+		modbus_long_poll_parse(&req[MODBUS_MBAP_LENGTH], req_len - MODBUS_MBAP_LENGTH, &parsed) < 0) {
+		return false;
 	}
 
-    // We trust our network to not DOS us with garbage
-    // TODO: file a request for a dropped message callback
-	if (k_sem_take(&response_ready, K_MSEC(500)) != 0) {
-		LOG_ERR("Wait time for response expired");
-		modbus_raw_set_server_failure(&tx_adu);
+	k_mutex_lock(&long_poll_lock, K_FOREVER);
+	for (int i = 0 ; i < MAX_LONG_POLLS ; i++) {
+		struct long_poll *poll = &long_polls[i];
+		if (!poll->active) {
+			poll->active = true;
+			poll->generation = parsed.generation;
+			poll->deadline = k_uptime_get() + MIN(parsed.timeout_s, LONG_POLL_MAX_TIMEOUT_S) * MSEC_PER_SEC;
+			poll->len = req_len;
+			memcpy(poll->req, req, req_len);
+			poll->client = *client;
+			poll->client.recv_buffer = NULL;
+			parked = true;
+			break;
+		}
 	}
+	k_mutex_unlock(&long_poll_lock);
 
-	#if CONFIG_OPENP1_UDP
-	return send_reply(0);
-	#else
-	return send_reply(request->socket);
-	#endif
+	if (parked) {
+		// Catches generations that changed while the request was processed
+		wake_long_polls();
+	} else {
+		LOG_WRN("Too many long polls, answering right away");
+	}
+	return parked;
 }
 
-#if CONFIG_OPENP1_UDP
-struct message_handler handler = {
-	.on_message_recived_cb = on_message_received,
-};
-#elif CONFIG_OPENP1_TCP
-struct tcp_message_handler handler = {
-	.on_message_recived_cb = on_message_received,
-};
-#endif
+void modbus_telegram_applied() {
+	wake_long_polls();
+}
 
+// Shared by all transports. Stream transports batch the replies of pipelined
+// requests themselves. Long poll replies are sent later, possibly after replies
+// to later transactions. Transports that can't reply later, like RTU, get the
+// long poll answered right away.
+int modbus_on_message_received(struct transport_request *request, uint8_t *resp, uint16_t resp_size) {
+	bool may_defer = request->transport->reply != NULL;
+	int ret = process_request(request->recv_buffer, request->len, resp, resp_size, may_defer);
+	if (ret == MODBUS_PDU_DEFERRED) {
+		bool parked = park_long_poll(request->recv_buffer, request->len, request);
+		ret = parked ? 0 : process_request(request->recv_buffer, request->len, resp, resp_size, false);
+	}
+	return ret;
+}
 
-int modbus_init(struct value_store *store) {
+static struct message_handler handler = {
+	.on_message_recived_cb = modbus_on_message_received,
+};
 
+void modbus_server_init(struct value_store *store) {
 	value_store = store;
+	response_cache_init(&response_cache, register_map_cacheable);
+	k_work_queue_start(&long_poll_queue, long_poll_stack, K_THREAD_STACK_SIZEOF(long_poll_stack),
+					   LONG_POLL_PRIORITY, NULL);
+	k_thread_name_set(&long_poll_queue.thread, "long_poll");
+	#if CONFIG_OPENP1_DENSE_MAP
+	register_map_enable_dense();
+	#endif
+	#if CONFIG_OPENP1_SUNSPEC
+	register_map_enable_sunspec(&sunspec_identity);
+	#endif
+}
 
+int modbus_init(struct value_store *store) {
+	modbus_server_init(store);
+
+	#if !CONFIG_OPENP1_UDP && !CONFIG_OPENP1_TCP && !CONFIG_OPENP1_RTU
+	LOG_ERR("No transport");
+	return -1;
+	#endif
 	#if CONFIG_OPENP1_UDP
-    if (udp_server_init(&handler) < 0) {
-        return -1;
-    }
-	#elif CONFIG_OPENP1_TCP
+	if (udp_server_init(&handler) < 0) {
+		return -1;
+	}
+	#endif
+	#if CONFIG_OPENP1_TCP
 	if (tcp_server_init(&handler) < 0) {
 		return -1;
 	}
-	#else
-	LOG_ERR("Unknown transport");
-	return -1;
 	#endif
-    
-	char iface_name[] = "RAW_0";
-	server_iface = modbus_iface_get_by_name(iface_name);
-
-	if (server_iface < 0) {
-		LOG_ERR("Failed to get iface index for %s", iface_name);
-		return -ENODEV;
+	#if CONFIG_OPENP1_RTU
+	if (rtu_server_init(&handler) < 0) {
+		return -1;
 	}
+	#endif
 
-	return modbus_init_server(server_iface, server_param);
+	return 0;
 }
\ No newline at end of file
@@ -4,10 +4,16 @@
 #include "lib/openp1.h"
 #include "lib/telegram.h"
 #include "lib/value_store.h"
+#include "lib/register_map.h"
 
-// Map Items to DATA_BASE_ADDRESS + item number * 32
-#define DATA_BASE_ADDRESS 0x0800
+struct transport_request;
 
 int modbus_init(struct value_store *store);
+// Request handling without the transports, part of modbus_init()
+void modbus_server_init(struct value_store *store);
+// The message handler of all transports
+int modbus_on_message_received(struct transport_request *request, uint8_t *resp, uint16_t resp_size);
+// Wakes long polls waiting for new data
+void modbus_telegram_applied();
 
-#endif /* MODBUS_H */
\ No newline at end of file
+#endif /* MODBUS_H */
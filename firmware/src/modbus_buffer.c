@@ -0,0 +1,52 @@
+#include "modbus_buffer.h"
+#include "udp.h"
+#include "tcp.h"
+#include "rtu.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+LOG_MODULE_REGISTER(modbus_buffer, LOG_LEVEL_DBG);
+
+// Slab blocks must be a multiple of the alignment
+#define BLOCK_SIZE ROUND_UP(MODBUS_BUFFER_SIZE, 4)
+
+// Every transport holds at most its own share of buffers at a time, so with
+// room for all shares no transport ever waits for the buffers of another
+#if CONFIG_OPENP1_UDP
+#define UDP_SHARE UDP_MODBUS_BUFFERS
+#else
+#define UDP_SHARE 0
+#endif
+#if CONFIG_OPENP1_TCP
+#define TCP_SHARE TCP_MODBUS_BUFFERS
+#else
+#define TCP_SHARE 0
+#endif
+#if CONFIG_OPENP1_RTU
+#define RTU_SHARE RTU_MODBUS_BUFFERS
+#else
+#define RTU_SHARE 0
+#endif
+#define MODBUS_BUFFERS MAX(UDP_SHARE + TCP_SHARE + RTU_SHARE, 1)
+
+K_MEM_SLAB_DEFINE_STATIC(modbus_buffer_slab, BLOCK_SIZE, MODBUS_BUFFERS, 4);
+
+uint8_t *modbus_buffer_alloc(k_timeout_t timeout) {
+	void *buf;
+
+	if (k_mem_slab_alloc(&modbus_buffer_slab, &buf, timeout) != 0) {
+		// Callers not waiting retry, and log themselves if they need to
+		if (!K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+			LOG_WRN("No free modbus buffer");
+		}
+		return NULL;
+	}
+	return buf;
+}
+
+void modbus_buffer_free(uint8_t *buf) {
+	void *block = buf;
+
+	k_mem_slab_free(&modbus_buffer_slab, &block);
+}
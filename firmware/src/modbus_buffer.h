@@ -0,0 +1,14 @@
+#ifndef MODBUS_BUFFER_HEADER_H
+#define MODBUS_BUFFER_HEADER_H
+
+#include "lib/modbus_pdu.h"
+
+#include <zephyr/kernel.h>
+
+// Buffers hold a full Modbus TCP ADU, shared by the transports
+#define MODBUS_BUFFER_SIZE MODBUS_MAX_ADU_LENGTH
+
+uint8_t *modbus_buffer_alloc(k_timeout_t timeout);
+void modbus_buffer_free(uint8_t *buf);
+
+#endif /* MODBUS_BUFFER_HEADER_H */
@@ -0,0 +1,235 @@
+#include "mqtt_sn_publisher.h"
+#include "lib/mqtt_sn.h"
+#include "lib/push.h"
+#include "lib/modbus_pdu.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/socket.h>
+
+LOG_MODULE_REGISTER(mqtt_sn_publisher, LOG_LEVEL_DBG);
+
+#if CONFIG_OPENP1_MQTT_SN
+
+#define STACK_SIZE 2048
+#define THREAD_PRIORITY 8
+#define CONNECT_TIMEOUT_MS 5000
+#define MAX_RETRY_INTERVAL_MS 60000
+#define KEEP_ALIVE_MS (CONFIG_OPENP1_MQTT_SN_KEEP_ALIVE_S * MSEC_PER_SEC)
+// Unanswered PINGREQs until the gateway is considered gone
+#define MAX_MISSED_PINGS 2
+
+static const struct push_config config = {
+	.min_interval_ms = CONFIG_OPENP1_MQTT_SN_MIN_INTERVAL_MS,
+	.full_interval_ms = CONFIG_OPENP1_MQTT_SN_FULL_INTERVAL_S * MSEC_PER_SEC,
+	.deadband = CONFIG_OPENP1_MQTT_SN_DEADBAND,
+};
+
+// Only used by the publish queue
+static struct push_state state;
+static uint8_t buf[MODBUS_FRAME_BUDGET];
+
+static int sock = -1;
+static atomic_t connected;
+// Set on every new session, the next round sends all items again
+static atomic_t resync;
+
+static int send_message(const uint8_t *msg, int len) {
+	if (len < 0) {
+		return len;
+	}
+	// Never waits for buffers, the gateway sees lost messages as for any datagram
+	if (send(sock, msg, len, ZSOCK_MSG_DONTWAIT) < 0) {
+		LOG_WRN("Failed to send to gateway: %d", errno);
+		return -errno;
+	}
+	return 0;
+}
+
+// Waits up to timeout_ms for a message from the gateway. Returns 0, or
+// -EAGAIN if none arrived.
+static int receive_message(struct mqtt_sn_message *msg, int timeout_ms) {
+	uint8_t rx_buf[16];
+	struct zsock_pollfd fds = { .fd = sock, .events = ZSOCK_POLLIN };
+	int64_t deadline = k_uptime_get() + timeout_ms;
+
+	do {
+		int ret = zsock_poll(&fds, 1, MAX(deadline - k_uptime_get(), 0));
+		if (ret < 0) {
+			return -errno;
+		} else if (ret == 0) {
+			return -EAGAIN;
+		}
+		int len = recv(sock, rx_buf, sizeof(rx_buf), 0);
+		if (len < 0) {
+			// E.g. ICMP port unreachable while the gateway is down
+			return -errno;
+		}
+		if (mqtt_sn_parse(rx_buf, len, msg) == 0) {
+			return 0;
+		}
+		LOG_WRN("Malformed message from gateway");
+	} while (k_uptime_get() < deadline);
+	return -EAGAIN;
+}
+
+static bool connect_gateway(void) {
+	// Large, kept off the stack
+	static uint8_t msg[MQTT_SN_MAX_LENGTH];
+	struct mqtt_sn_message reply;
+	int64_t deadline = k_uptime_get() + CONNECT_TIMEOUT_MS;
+
+	if (send_message(msg, mqtt_sn_encode_connect(msg, sizeof(msg), CONFIG_OPENP1_HOSTNAME,
+						     CONFIG_OPENP1_MQTT_SN_KEEP_ALIVE_S)) < 0) {
+		return false;
+	}
+	while (receive_message(&reply, MAX(deadline - k_uptime_get(), 0)) == 0) {
+		if (reply.type != MQTT_SN_CONNACK) {
+			continue;
+		}
+		if (reply.return_code != MQTT_SN_ACCEPTED) {
+			LOG_WRN("Gateway rejected connection: %d", reply.return_code);
+			return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+// Keeps the session alive until the gateway disconnects or stops answering
+static void keep_alive(void) {
+	uint8_t msg[2];
+	struct mqtt_sn_message reply;
+	int missed = 0;
+
+	while (missed <= MAX_MISSED_PINGS) {
+		int64_t next_ping = k_uptime_get() + KEEP_ALIVE_MS / 2;
+		int ret;
+
+		while ((ret = receive_message(&reply, MAX(next_ping - k_uptime_get(), 0))) == 0) {
+			if (reply.type == MQTT_SN_PINGRESP) {
+				missed = 0;
+			} else if (reply.type == MQTT_SN_DISCONNECT) {
+				LOG_WRN("Disconnected by gateway");
+				return;
+			}
+		}
+		if (ret != -EAGAIN) {
+			return;
+		}
+		send_message(msg, mqtt_sn_encode_pingreq(msg, sizeof(msg)));
+		missed++;
+	}
+	LOG_WRN("Gateway stopped answering");
+}
+
+static void mqtt_sn_task(void *p1, void *p2, void *p3) {
+	int retry_ms = CONNECT_TIMEOUT_MS;
+
+	while (true) {
+		if (!connect_gateway()) {
+			k_sleep(K_MSEC(retry_ms));
+			retry_ms = MIN(retry_ms * 2, MAX_RETRY_INTERVAL_MS);
+			continue;
+		}
+		LOG_INF("Connected to MQTT-SN gateway");
+		retry_ms = CONNECT_TIMEOUT_MS;
+		atomic_set(&resync, true);
+		atomic_set(&connected, true);
+		keep_alive();
+		atomic_set(&connected, false);
+	}
+}
+
+K_THREAD_DEFINE(mqtt_sn_thread_id, STACK_SIZE,
+    mqtt_sn_task, NULL, NULL, NULL,
+    THREAD_PRIORITY, 0, -1);
+
+int mqtt_sn_publisher_init(void) {
+	struct sockaddr_in6 gateway = {
+		.sin6_family = AF_INET6,
+		.sin6_port = htons(CONFIG_OPENP1_MQTT_SN_PORT),
+	};
+
+	if (inet_pton(AF_INET6, CONFIG_OPENP1_MQTT_SN_GATEWAY, &gateway.sin6_addr) != 1) {
+		LOG_ERR("Invalid MQTT-SN gateway address %s", CONFIG_OPENP1_MQTT_SN_GATEWAY);
+		return -EINVAL;
+	}
+
+	sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		LOG_ERR("Failed to create MQTT-SN socket: %d", errno);
+		return -errno;
+	}
+	// Only the gateway is heard, and sent to without an address
+	if (connect(sock, (struct sockaddr *) &gateway, sizeof(gateway)) < 0) {
+		LOG_ERR("Failed to connect MQTT-SN socket: %d", errno);
+		return -errno;
+	}
+
+	k_thread_name_set(mqtt_sn_thread_id, "mqtt_sn");
+	k_thread_start(mqtt_sn_thread_id);
+
+	LOG_INF("Publishing telegrams to MQTT-SN gateway [%s]:%d", CONFIG_OPENP1_MQTT_SN_GATEWAY,
+		CONFIG_OPENP1_MQTT_SN_PORT);
+	return 0;
+}
+
+// Called from the publish queue after telegrams. Changed items are batched into PUBLISHes
+// to the snapshot topic, in the push datagram format, then published one by
+// one to their item topics. Nothing is queued while disconnected.
+void mqtt_sn_telegram_applied(struct value_store *store) {
+	int len;
+	int publishes = 0;
+
+	if (sock < 0 || !atomic_get(&connected)) {
+		return;
+	}
+	if (atomic_cas(&resync, true, false)) {
+		push_init(&state);
+	}
+
+	value_store_lock(store);
+	int items = push_collect(&state, &config, store, k_uptime_get());
+	uint64_t pending __maybe_unused = state.pending;
+	value_store_unlock(store);
+	if (items == 0) {
+		return;
+	}
+
+	do {
+		value_store_lock(store);
+		len = push_encode(&state, store, &buf[MQTT_SN_PUBLISH_HEADER_LENGTH],
+				  sizeof(buf) - MQTT_SN_PUBLISH_HEADER_LENGTH);
+		value_store_unlock(store);
+		if (len > 0) {
+			len = mqtt_sn_encode_publish(buf, sizeof(buf), CONFIG_OPENP1_MQTT_SN_SNAPSHOT_TOPIC_ID, len);
+			send_message(buf, len);
+			publishes++;
+		}
+	} while (len > 0);
+
+	#if CONFIG_OPENP1_MQTT_SN_ITEM_TOPICS
+	for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+		if (!(pending & BIT64(i))) {
+			continue;
+		}
+		value_store_lock(store);
+		len = mqtt_sn_encode_item(store, i, CONFIG_OPENP1_MQTT_SN_ITEM_TOPIC_BASE + i, buf, sizeof(buf));
+		value_store_unlock(store);
+		send_message(buf, len);
+		publishes++;
+	}
+	#endif
+	LOG_DBG("Published %d items in %d messages", items, publishes);
+}
+
+#else
+
+int mqtt_sn_publisher_init(void) {
+	return 0;
+}
+
+void mqtt_sn_telegram_applied(struct value_store *store) {}
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef MQTT_SN_PUBLISHER_HEADER_H
+#define MQTT_SN_PUBLISHER_HEADER_H
+
+#include "lib/value_store.h"
+
+int mqtt_sn_publisher_init(void);
+void mqtt_sn_telegram_applied(struct value_store *store);
+
+#endif /* MQTT_SN_PUBLISHER_HEADER_H */
@@ -5,6 +5,7 @@
 
 #include "lib/parser.h"
 #include "lib/openp1.h"
+#include "lib/stats.h"
 
 LOG_MODULE_REGISTER(parser_task, LOG_LEVEL_DBG);
 
@@ -43,6 +44,7 @@ void parser_task(void *, void *, void *) {
             telegram_message discard;
             while(k_msgq_get(telegram_queue, &discard, K_NO_WAIT) == 0) {
                 telegram_free(discard.telegram);
+                stats_increment(STAT_TELEGRAMS_DISCARDED);
                 LOG_WRN("Telegram overrun, discarding message");
             }
 
@@ -51,6 +53,8 @@ void parser_task(void *, void *, void *) {
                 LOG_ERR("Failed to send message, %d", ret);
                 telegram_free(telegram);
             }
+        } else {
+            stats_increment(STAT_PARSE_ERRORS);
         }
         net_buf_unref(telegram_buf);
     }
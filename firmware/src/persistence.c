@@ -0,0 +1,292 @@
+#include "persistence.h"
+#include "lib/value_store.h"
+#include "lib/snapshot.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+
+LOG_MODULE_REGISTER(persistence, LOG_LEVEL_DBG);
+
+#if CONFIG_OPENP1_PERSIST
+
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+
+// Bump when the layout of any persisted struct changes, old snapshots are then ignored
+#define SUBTREE "openp1"
+#define VERSION "v1"
+
+enum section {
+    SECTION_ROWS,
+    SECTION_DEMAND,
+    SECTION_HISTORY,
+    SECTION_AGGREGATE = SECTION_HISTORY + FIRST_VIRTUAL_ITEM,
+    __NUM_SECTIONS = SECTION_AGGREGATE + DERIVED_MAX_SOURCES,
+};
+
+// Scratch copy of one section, times converted to be relative to the snapshot
+static union {
+    struct snapshot rows;
+    struct demand_tracker demand;
+    struct history history;
+    struct aggregate aggregate;
+} scratch;
+
+// Rows are saved as a snapshot with ages, far smaller than the rows themselves.
+// It carries its own version, rows of other versions are ignored on load.
+static uint8_t encoded_rows[SNAPSHOT_MAX_LENGTH];
+
+// CRC of the last written content of each section, unchanged sections are not rewritten
+static uint32_t written_crc[__NUM_SECTIONS];
+
+// Set once settings are available, nothing is saved otherwise
+static struct value_store *value_store;
+static int64_t last_save;
+static int64_t last_aggregate_save;
+static bool restored;
+
+static void section_name(enum section section, char *name, size_t len) {
+    if (section == SECTION_ROWS) {
+        snprintk(name, len, SUBTREE "/" VERSION "/rows");
+    } else if (section == SECTION_DEMAND) {
+        snprintk(name, len, SUBTREE "/" VERSION "/demand");
+    } else if (section < SECTION_AGGREGATE) {
+        snprintk(name, len, SUBTREE "/" VERSION "/history/%d", section - SECTION_HISTORY);
+    } else {
+        snprintk(name, len, SUBTREE "/" VERSION "/aggregate/%d", section - SECTION_AGGREGATE);
+    }
+}
+
+// The date has no history, it is not numeric
+static bool section_saved(enum section section) {
+    return section < SECTION_HISTORY || section >= SECTION_AGGREGATE ||
+           data_definition_table[section - SECTION_HISTORY].format != DATE_TIME_STRING;
+}
+
+// Location of a section other than the rows in the store, and its size
+static void *section_data(struct value_store *store, enum section section, size_t *len) {
+    if (section == SECTION_DEMAND) {
+        *len = sizeof(store->demand);
+        return &store->demand;
+    } else if (section < SECTION_AGGREGATE) {
+        *len = sizeof(store->history[0]);
+        return &store->history[section - SECTION_HISTORY];
+    } else {
+        *len = sizeof(store->derived.aggregates[0]);
+        return &store->derived.aggregates[section - SECTION_AGGREGATE];
+    }
+}
+
+static void rebase_scratch(enum section section, int64_t delta) {
+    if (section == SECTION_DEMAND) {
+        // Meter time only
+    } else if (section < SECTION_AGGREGATE) {
+        history_rebase(&scratch.history, delta);
+    } else {
+        sliding_window_rebase(&scratch.aggregate.window, delta);
+    }
+}
+
+static int encode_rows(struct value_store *store, int64_t now) {
+    uint64_t items = 0;
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (store->rows[i].last_updated != NEVER_UPDATED) {
+            items |= BIT64(i);
+        }
+    }
+    return snapshot_encode(store, items, NULL, SNAPSHOT_FLAG_AGES, now, encoded_rows, sizeof(encoded_rows));
+}
+
+// The section is copied with the store locked, and written after unlocking it
+static int save_section(struct value_store *store, enum section section, int64_t now) {
+    char name[32];
+    size_t len;
+    const void *content = &scratch;
+
+    if (section == SECTION_ROWS) {
+        value_store_lock(store);
+        int ret = encode_rows(store, now);
+        value_store_unlock(store);
+        if (ret < 0) {
+            return ret;
+        }
+        content = encoded_rows;
+        len = ret;
+    } else {
+        value_store_lock(store);
+        void *data = section_data(store, section, &len);
+        memcpy(&scratch, data, len);
+        value_store_unlock(store);
+        rebase_scratch(section, -now);
+    }
+
+    uint32_t crc = crc32_ieee(content, len);
+    if (crc == written_crc[section]) {
+        return 0;
+    }
+
+    section_name(section, name, sizeof(name));
+    int ret = settings_save_one(name, content, len);
+    if (ret < 0) {
+        LOG_ERR("Failed to save %s: %d", name, ret);
+        return ret;
+    }
+    written_crc[section] = crc;
+    return 1;
+}
+
+// Decodes the rows, with times relative to the snapshot
+static int load_rows(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    if (len > sizeof(encoded_rows)) {
+        LOG_WRN("Ignoring %s, size %d", key, len);
+        return 0;
+    }
+    int ret = read_cb(cb_arg, encoded_rows, len);
+    if (ret != len) {
+        LOG_ERR("Failed to read %s: %d", key, ret);
+        return ret < 0 ? ret : -EIO;
+    }
+    ret = snapshot_decode(encoded_rows, len, NULL, &scratch.rows);
+    if (ret < 0) {
+        LOG_WRN("Ignoring %s: %d", key, ret);
+        return 0;
+    }
+    for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+        if (scratch.rows.items & BIT64(i)) {
+            value_store->rows[i] = scratch.rows.rows[i];
+        }
+    }
+    written_crc[SECTION_ROWS] = crc32_ieee(encoded_rows, len);
+    restored = true;
+    return 0;
+}
+
+static int settings_set(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    const char *next;
+    enum section section;
+
+    if (value_store == NULL || !settings_name_steq(key, VERSION, &next) || next == NULL) {
+        // Snapshot of another firmware version
+        return 0;
+    }
+
+    if (settings_name_steq(next, "rows", NULL)) {
+        return load_rows(key, len, read_cb, cb_arg);
+    } else if (settings_name_steq(next, "demand", NULL)) {
+        section = SECTION_DEMAND;
+    } else if (strncmp(next, "history/", 8) == 0) {
+        section = SECTION_HISTORY + atoi(&next[8]);
+        if (section < SECTION_HISTORY || section >= SECTION_AGGREGATE || !section_saved(section)) {
+            return -ENOENT;
+        }
+    } else if (strncmp(next, "aggregate/", 10) == 0) {
+        section = SECTION_AGGREGATE + atoi(&next[10]);
+        if (section < SECTION_AGGREGATE || section >= __NUM_SECTIONS) {
+            return -ENOENT;
+        }
+    } else {
+        return -ENOENT;
+    }
+
+    size_t expected;
+    void *data = section_data(value_store, section, &expected);
+    if (len != expected) {
+        LOG_WRN("Ignoring %s, size %d != %d", key, len, expected);
+        return 0;
+    }
+    int ret = read_cb(cb_arg, &scratch, len);
+    if (ret != len) {
+        LOG_ERR("Failed to read %s: %d", key, ret);
+        return ret < 0 ? ret : -EIO;
+    }
+    written_crc[section] = crc32_ieee((uint8_t *) &scratch, len);
+    memcpy(data, &scratch, len);
+    restored = true;
+    return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(openp1, SUBTREE, NULL, settings_set, NULL, NULL);
+
+// Restores the last snapshot into an initialized store. Without settings, the
+// store is left empty and never saved.
+int persistence_init(struct value_store *store) {
+    int ret = settings_subsys_init();
+    if (ret < 0) {
+        LOG_ERR("Failed to initialize settings: %d", ret);
+        return ret;
+    }
+
+    value_store = store;
+    ret = settings_load_subtree(SUBTREE);
+    if (ret < 0) {
+        LOG_ERR("Failed to load snapshot: %d", ret);
+        value_store_init(store);
+        return 0;
+    }
+
+    last_save = k_uptime_get();
+    last_aggregate_save = last_save;
+    if (restored) {
+        // Downtime is unknown, values keep the age they had when saved, and
+        // are stale until the meter sends them again
+        value_store_restore(store, last_save);
+        LOG_INF("Value store restored from snapshot");
+    }
+    return 0;
+}
+
+// Saves the changed sections, the aggregates only if asked to. Returns how
+// many were written.
+static int save(struct value_store *store, bool aggregates) {
+    int64_t now = k_uptime_get();
+    int written = 0;
+
+    last_save = now;
+    if (aggregates) {
+        last_aggregate_save = now;
+    }
+    for (enum section section = 0 ; section < __NUM_SECTIONS ; section++) {
+        if (!section_saved(section) || (section >= SECTION_AGGREGATE && !aggregates)) {
+            continue;
+        }
+        if (save_section(store, section, now) > 0) {
+            written++;
+        }
+    }
+    LOG_INF("Snapshot saved, %d sections changed", written);
+    return written;
+}
+
+int persistence_save(struct value_store *store) {
+    if (value_store == NULL) {
+        return 0;
+    }
+    return save(store, true);
+}
+
+// Called from the publish queue after telegrams. The aggregates, the largest
+// sections, are saved on a longer interval than the rest.
+void persistence_telegram_applied(struct value_store *store) {
+    int64_t now = k_uptime_get();
+
+    if (value_store == NULL || now - last_save < CONFIG_OPENP1_PERSIST_INTERVAL_S * MSEC_PER_SEC) {
+        return;
+    }
+    save(store, now - last_aggregate_save >= CONFIG_OPENP1_PERSIST_AGGREGATE_INTERVAL_S * MSEC_PER_SEC);
+}
+
+#else
+
+int persistence_init(struct value_store *store) {
+	LOG_INF("Persistence not enabled");
+	return 0;
+}
+
+int persistence_save(struct value_store *store) {
+	return 0;
+}
+
+void persistence_telegram_applied(struct value_store *store) {}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef PERSISTENCE_HEADER_H
+#define PERSISTENCE_HEADER_H
+
+#include "lib/value_store.h"
+
+int persistence_init(struct value_store *store);
+// Saves the sections changed since the last save. Returns how many were written.
+int persistence_save(struct value_store *store);
+void persistence_telegram_applied(struct value_store *store);
+
+#endif /* PERSISTENCE_HEADER_H */
@@ -0,0 +1,84 @@
+#include "push_publisher.h"
+#include "lib/push.h"
+#include "lib/modbus_pdu.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/socket.h>
+
+LOG_MODULE_REGISTER(push_publisher, LOG_LEVEL_DBG);
+
+#if CONFIG_OPENP1_PUSH
+
+static const struct push_config config = {
+	.min_interval_ms = CONFIG_OPENP1_PUSH_MIN_INTERVAL_MS,
+	.full_interval_ms = CONFIG_OPENP1_PUSH_FULL_INTERVAL_S * MSEC_PER_SEC,
+	.deadband = CONFIG_OPENP1_PUSH_DEADBAND,
+};
+
+static struct push_state state;
+static struct sockaddr_in6 destination;
+static int sock = -1;
+// Datagrams sized like Modbus UDP replies, to fit one 802.15.4 frame
+static uint8_t buf[MODBUS_FRAME_BUDGET];
+
+int push_publisher_init(void) {
+	push_init(&state);
+
+	destination.sin6_family = AF_INET6;
+	destination.sin6_port = htons(CONFIG_OPENP1_PUSH_PORT);
+	if (inet_pton(AF_INET6, CONFIG_OPENP1_PUSH_ADDRESS, &destination.sin6_addr) != 1) {
+		LOG_ERR("Invalid push address %s", CONFIG_OPENP1_PUSH_ADDRESS);
+		return -EINVAL;
+	}
+
+	sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		LOG_ERR("Failed to create push socket: %d", errno);
+		return -errno;
+	}
+	LOG_INF("Publishing telegrams to [%s]:%d", CONFIG_OPENP1_PUSH_ADDRESS, CONFIG_OPENP1_PUSH_PORT);
+	return 0;
+}
+
+// Called from the publish queue after telegrams. The store is locked while
+// encoding, not while sending, and sends never wait for buffers.
+void push_telegram_applied(struct value_store *store) {
+	int len;
+	int datagrams = 0;
+
+	if (sock < 0) {
+		return;
+	}
+
+	value_store_lock(store);
+	int items = push_collect(&state, &config, store, k_uptime_get());
+	value_store_unlock(store);
+	if (items == 0) {
+		return;
+	}
+
+	do {
+		value_store_lock(store);
+		len = push_encode(&state, store, buf, sizeof(buf));
+		value_store_unlock(store);
+		if (len > 0) {
+			if (sendto(sock, buf, len, ZSOCK_MSG_DONTWAIT, (struct sockaddr *) &destination,
+				   sizeof(destination)) < 0) {
+				LOG_WRN("Failed to push: %d", errno);
+			}
+			datagrams++;
+		}
+	} while (len > 0);
+	LOG_DBG("Pushed %d items in %d datagrams", items, datagrams);
+}
+
+#else
+
+int push_publisher_init(void) {
+	return 0;
+}
+
+void push_telegram_applied(struct value_store *store) {}
+
+#endif
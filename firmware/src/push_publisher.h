@@ -0,0 +1,9 @@
+#ifndef PUSH_PUBLISHER_HEADER_H
+#define PUSH_PUBLISHER_HEADER_H
+
+#include "lib/value_store.h"
+
+int push_publisher_init(void);
+void push_telegram_applied(struct value_store *store);
+
+#endif /* PUSH_PUBLISHER_HEADER_H */
@@ -0,0 +1,211 @@
+#include "raw_telegram.h"
+
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+
+LOG_MODULE_REGISTER(raw_telegram, LOG_LEVEL_DBG);
+
+#if CONFIG_OPENP1_RAW_TELEGRAM
+
+#define STACK_SIZE 1536
+#define THREAD_PRIORITY 8
+#define PORT CONFIG_OPENP1_RAW_TELEGRAM_PORT
+#define MAX_SUBSCRIBERS CONFIG_OPENP1_RAW_TELEGRAM_MAX_SUBSCRIBERS
+#define LISTEN_BACKLOG 2
+// Also the delay until a new frame is sent
+#define POLL_INTERVAL_MS 100
+
+// A subscriber holds a reference to the frame it is being sent, if any
+struct subscriber {
+  int sock;
+  struct net_buf *frame;
+  uint16_t sent;
+  bool dropped;
+};
+
+static int listen_sock = -1;
+static struct subscriber subscribers[MAX_SUBSCRIBERS];
+// Taken by the framer to hand out frames and by the server around sends
+K_MUTEX_DEFINE(subscribers_lock);
+
+// Listen socket first, followed by one entry per subscriber
+static struct zsock_pollfd fds[1 + MAX_SUBSCRIBERS];
+
+// Called from the framer task, never waits for the network. A subscriber still
+// sending the previous frame is too slow for the meter and is dropped, so that
+// at most one frame is held for all subscribers.
+void raw_telegram_publish(struct net_buf *frame) {
+  if (listen_sock < 0) {
+    return;
+  }
+  k_mutex_lock(&subscribers_lock, K_FOREVER);
+  for (int i = 0 ; i < MAX_SUBSCRIBERS ; i++) {
+    struct subscriber *sub = &subscribers[i];
+    if (sub->sock < 0 || sub->dropped) {
+      continue;
+    }
+    if (sub->frame != NULL) {
+      net_buf_unref(sub->frame);
+      sub->frame = NULL;
+      sub->dropped = true;
+      continue;
+    }
+    sub->frame = net_buf_ref(frame);
+    sub->sent = 0;
+  }
+  k_mutex_unlock(&subscribers_lock);
+}
+
+static void close_subscriber(struct subscriber *sub) {
+  if (sub->frame != NULL) {
+    net_buf_unref(sub->frame);
+    sub->frame = NULL;
+  }
+  close(sub->sock);
+  sub->sock = -1;
+  sub->dropped = false;
+}
+
+// Sends as much of the frame as the socket takes. Returns a negative value if
+// the subscriber is gone.
+static int send_frame(struct subscriber *sub) {
+  int ret = send(sub->sock, &sub->frame->data[sub->sent], sub->frame->len - sub->sent, ZSOCK_MSG_DONTWAIT);
+  if (ret < 0) {
+    return errno == EAGAIN ? 0 : -errno;
+  }
+  sub->sent += ret;
+  if (sub->sent == sub->frame->len) {
+    net_buf_unref(sub->frame);
+    sub->frame = NULL;
+  }
+  return 0;
+}
+
+static void accept_subscriber(void) {
+  struct sockaddr_in6 client_addr;
+  socklen_t client_addr_len = sizeof(client_addr);
+
+  int sock = accept(listen_sock, (struct sockaddr *) &client_addr, &client_addr_len);
+  if (sock < 0) {
+    LOG_ERR("Accept error %d", errno);
+    return;
+  }
+
+  k_mutex_lock(&subscribers_lock, K_FOREVER);
+  for (int i = 0 ; i < MAX_SUBSCRIBERS ; i++) {
+    if (subscribers[i].sock < 0) {
+      subscribers[i].sock = sock;
+      sock = -1;
+      break;
+    }
+  }
+  k_mutex_unlock(&subscribers_lock);
+
+  if (sock >= 0) {
+    LOG_WRN("Too many raw telegram subscribers");
+    close(sock);
+  } else {
+    LOG_INF("Raw telegram subscriber connected");
+  }
+}
+
+static void raw_telegram_task(void *p1, void *p2, void *p3) {
+  uint8_t discard[16];
+
+  LOG_INF("Streaming raw telegrams on port %d...", PORT);
+
+  while (true) {
+    fds[0].fd = listen_sock;
+    fds[0].events = ZSOCK_POLLIN;
+    k_mutex_lock(&subscribers_lock, K_FOREVER);
+    for (int i = 0 ; i < MAX_SUBSCRIBERS ; i++) {
+      fds[1 + i].fd = subscribers[i].sock; // Negative, unused slots are ignored
+      fds[1 + i].events = ZSOCK_POLLIN | (subscribers[i].frame != NULL ? ZSOCK_POLLOUT : 0);
+    }
+    k_mutex_unlock(&subscribers_lock);
+
+    if (zsock_poll(fds, ARRAY_SIZE(fds), POLL_INTERVAL_MS) < 0) {
+      LOG_ERR("Poll error %d", errno);
+      break;
+    }
+
+    k_mutex_lock(&subscribers_lock, K_FOREVER);
+    for (int i = 0 ; i < MAX_SUBSCRIBERS ; i++) {
+      struct subscriber *sub = &subscribers[i];
+      short revents = fds[1 + i].revents;
+
+      if (sub->sock < 0 || sub->sock != fds[1 + i].fd) {
+        continue;
+      }
+      if (sub->dropped) {
+        LOG_WRN("Dropping slow raw telegram subscriber");
+        close_subscriber(sub);
+        continue;
+      }
+      if (revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP | ZSOCK_POLLNVAL)) {
+        close_subscriber(sub);
+        continue;
+      }
+      // Subscribers only listen, anything received is discarded
+      if ((revents & ZSOCK_POLLIN) && recv(sub->sock, discard, sizeof(discard), ZSOCK_MSG_DONTWAIT) <= 0) {
+        LOG_INF("Raw telegram subscriber disconnected");
+        close_subscriber(sub);
+        continue;
+      }
+      // Frames handed out during the poll are sent on the next round
+      if (sub->frame != NULL && (revents & ZSOCK_POLLOUT) && send_frame(sub) < 0) {
+        close_subscriber(sub);
+      }
+    }
+    k_mutex_unlock(&subscribers_lock);
+
+    if (fds[0].revents & ZSOCK_POLLIN) {
+      accept_subscriber();
+    }
+  }
+}
+
+K_THREAD_DEFINE(raw_telegram_thread_id, STACK_SIZE,
+    raw_telegram_task, NULL, NULL, NULL,
+    THREAD_PRIORITY, 0, -1);
+
+int raw_telegram_server_init(void) {
+  struct sockaddr_in6 addr;
+
+  for (int i = 0 ; i < MAX_SUBSCRIBERS ; i++) {
+    subscribers[i].sock = -1;
+  }
+
+  (void)memset(&addr, 0, sizeof(addr));
+  addr.sin6_family = AF_INET6;
+  addr.sin6_port = htons(PORT);
+
+  listen_sock = socket(addr.sin6_family, SOCK_STREAM, IPPROTO_TCP);
+  if (listen_sock < 0) {
+    LOG_ERR("Failed to create raw telegram socket: %d", errno);
+    return -errno;
+  }
+  if (bind(listen_sock, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    LOG_ERR("Failed to bind raw telegram socket: %d", errno);
+    return -errno;
+  }
+  if (listen(listen_sock, LISTEN_BACKLOG) < 0) {
+    LOG_ERR("Failed to listen on raw telegram socket: %d", errno);
+    return -errno;
+  }
+
+  k_thread_name_set(raw_telegram_thread_id, "raw_telegram");
+  k_thread_start(raw_telegram_thread_id);
+  return 0;
+}
+
+#else
+
+int raw_telegram_server_init(void) {
+  return 0;
+}
+
+void raw_telegram_publish(struct net_buf *frame) {}
+
+#endif
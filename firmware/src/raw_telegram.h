@@ -0,0 +1,10 @@
+#ifndef RAW_TELEGRAM_HEADER_H
+#define RAW_TELEGRAM_HEADER_H
+
+#include <zephyr/net/buf.h>
+
+int raw_telegram_server_init(void);
+// Hands a verified frame to every subscriber, each taking a reference
+void raw_telegram_publish(struct net_buf *frame);
+
+#endif /* RAW_TELEGRAM_HEADER_H */
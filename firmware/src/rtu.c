@@ -0,0 +1,212 @@
+#include "rtu.h"
+#include "lib/modbus_rtu.h"
+
+#include <zephyr/drivers/uart.h>
+#include <zephyr/device.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/kernel.h>
+
+#include <string.h>
+
+#if CONFIG_OPENP1_RTU
+
+LOG_MODULE_REGISTER(rtu, LOG_LEVEL_DBG);
+
+#define STACK_SIZE 2048
+#define RTU_THREAD_PRIORITY 8
+#define RX_QUEUE_FRAMES 2
+#define BUFFER_TIMEOUT K_MSEC(100)
+#if !CONFIG_UART_INTERRUPT_DRIVEN
+// Drivers without interrupts, e.g. the native_posix pty, are polled
+#define RX_POLL_INTERVAL K_USEC(500)
+#endif
+
+#define RTU_UART_NODE DT_CHOSEN(openp1_rtu_uart)
+
+struct rtu_frame {
+  uint16_t len;
+  uint8_t data[MODBUS_RTU_MAX_FRAME_LENGTH];
+};
+
+static const struct device *const uart_dev = DEVICE_DT_GET(RTU_UART_NODE);
+
+// Characters are always 11 bits, without parity the second stop bit takes its place
+static const struct uart_config uart_cfg = {
+  .baudrate = CONFIG_OPENP1_RTU_BAUDRATE,
+  .parity = CONFIG_OPENP1_RTU_PARITY,
+  .stop_bits = CONFIG_OPENP1_RTU_PARITY == UART_CFG_PARITY_NONE ? UART_CFG_STOP_BITS_2 : UART_CFG_STOP_BITS_1,
+  .data_bits = UART_CFG_DATA_BITS_8,
+  .flow_ctrl = UART_CFG_FLOW_CTRL_NONE
+};
+
+static struct message_handler *handler;
+static k_timeout_t frame_gap;
+
+// Frame being received, shared by the receive path and the gap timer
+static struct rtu_frame rx_frame;
+static bool rx_overrun;
+static struct k_spinlock rx_lock;
+
+K_MSGQ_DEFINE(rx_frames, sizeof(struct rtu_frame), RX_QUEUE_FRAMES, 4);
+
+// Replies can't be sent later, the master only waits for a reply to the
+// request it sent last
+static const struct transport rtu_transport = {
+  .name = "rtu",
+  .reply = NULL,
+  .frame_budget = 0,
+};
+
+// The line was silent for 3.5 characters, the frame is complete
+static void frame_gap_expiry(struct k_timer *timer) {
+  k_spinlock_key_t key = k_spin_lock(&rx_lock);
+
+  if (rx_frame.len > 0 && !rx_overrun) {
+    if (k_msgq_put(&rx_frames, &rx_frame, K_NO_WAIT) < 0) {
+      LOG_WRN("Dropping frame, server busy");
+    }
+  }
+  rx_frame.len = 0;
+  rx_overrun = false;
+  k_spin_unlock(&rx_lock, key);
+}
+
+K_TIMER_DEFINE(frame_gap_timer, frame_gap_expiry, NULL);
+
+static void receive_bytes(const uint8_t *buf, int len) {
+  k_spinlock_key_t key = k_spin_lock(&rx_lock);
+
+  if (rx_frame.len + len > sizeof(rx_frame.data)) {
+    rx_overrun = true;
+  } else {
+    memcpy(&rx_frame.data[rx_frame.len], buf, len);
+    rx_frame.len += len;
+  }
+  k_timer_start(&frame_gap_timer, frame_gap, K_NO_WAIT);
+  k_spin_unlock(&rx_lock, key);
+}
+
+#if CONFIG_UART_INTERRUPT_DRIVEN
+static void uart_cb(const struct device *dev, void *user_data) {
+  uint8_t buf[32];
+  int len;
+
+  if (!uart_irq_update(dev) || !uart_irq_rx_ready(dev)) {
+    return;
+  }
+  while ((len = uart_fifo_read(dev, buf, sizeof(buf))) > 0) {
+    receive_bytes(buf, len);
+  }
+}
+#else
+static void rtu_poll_task(void *p1, void *p2, void *p3) {
+  uint8_t c;
+
+  while (true) {
+    while (uart_poll_in(uart_dev, &c) == 0) {
+      receive_bytes(&c, 1);
+    }
+    k_sleep(RX_POLL_INTERVAL);
+  }
+}
+
+K_THREAD_DEFINE(rtu_poll_thread_id, STACK_SIZE,
+    rtu_poll_task, NULL, NULL, NULL,
+    RTU_THREAD_PRIORITY, 0, -1);
+#endif
+
+static void send_frame(const uint8_t *frame, int len) {
+  // Poll out also paces the transmission on drivers without a FIFO
+  for (int i = 0 ; i < len ; i++) {
+    uart_poll_out(uart_dev, frame[i]);
+  }
+}
+
+static void serve_frame(struct rtu_frame *frame) {
+  struct transport_request request = {
+    .transport = &rtu_transport,
+  };
+  uint8_t *adu = modbus_buffer_alloc(BUFFER_TIMEOUT);
+  uint8_t *resp = modbus_buffer_alloc(BUFFER_TIMEOUT);
+
+  if (adu == NULL || resp == NULL) {
+    LOG_WRN("No buffers, dropping frame"); // The master will retry
+    goto out;
+  }
+
+  int len = modbus_rtu_to_adu(frame->data, frame->len, adu, MODBUS_BUFFER_SIZE);
+  if (len <= 0) {
+    goto out; // Malformed frames are not answered
+  }
+  request.len = len;
+  request.recv_buffer = adu;
+
+  len = handler->on_message_recived_cb(&request, resp, MODBUS_BUFFER_SIZE);
+  if (len > 0) {
+    // The ADU buffer is free again and takes the frame
+    len = modbus_rtu_from_adu(resp, len, adu, MODBUS_BUFFER_SIZE);
+    if (len > 0) {
+      send_frame(adu, len);
+    }
+  }
+out:
+  if (adu != NULL) {
+    modbus_buffer_free(adu);
+  }
+  if (resp != NULL) {
+    modbus_buffer_free(resp);
+  }
+}
+
+static void rtu_server_task(void *p1, void *p2, void *p3) {
+  // Large, kept off the stack
+  static struct rtu_frame frame;
+
+  LOG_INF("Serving Modbus RTU at %d baud", uart_cfg.baudrate);
+  while (true) {
+    k_msgq_get(&rx_frames, &frame, K_FOREVER);
+    serve_frame(&frame);
+  }
+}
+
+K_THREAD_DEFINE(rtu_thread_id, STACK_SIZE,
+    rtu_server_task, NULL, NULL, NULL,
+    RTU_THREAD_PRIORITY, 0, -1);
+
+int rtu_server_init(struct message_handler *message_handler) {
+  int ret;
+
+  handler = message_handler;
+  frame_gap = K_USEC(modbus_rtu_frame_gap_us(uart_cfg.baudrate));
+
+  if (!device_is_ready(uart_dev)) {
+    LOG_ERR("RTU uart not ready");
+    return -ENODEV;
+  }
+  ret = uart_configure(uart_dev, &uart_cfg);
+  if (ret == -ENOSYS) {
+    LOG_WRN("RTU uart can't be configured, using its defaults");
+  } else if (ret < 0) {
+    LOG_ERR("Failed to configure RTU uart: %d", ret);
+    return ret;
+  }
+
+#if CONFIG_UART_INTERRUPT_DRIVEN
+  ret = uart_irq_callback_user_data_set(uart_dev, uart_cb, NULL);
+  if (ret < 0) {
+    return ret;
+  }
+  uart_irq_rx_enable(uart_dev);
+#else
+  k_thread_name_set(rtu_poll_thread_id, "rtu_poll");
+  k_thread_start(rtu_poll_thread_id);
+#endif
+
+  k_thread_name_set(rtu_thread_id, "rtu");
+  k_thread_start(rtu_thread_id);
+
+  LOG_INF("RTU server initialized");
+  return 0;
+}
+
+#endif
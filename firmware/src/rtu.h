@@ -0,0 +1,11 @@
+#ifndef RTU_HEADER_H
+#define RTU_HEADER_H
+
+#include "transport.h"
+
+// The ADU of a frame and its reply
+#define RTU_MODBUS_BUFFERS 2
+
+int rtu_server_init(struct message_handler *handler);
+
+#endif /* RTU_HEADER_H */
@@ -1,10 +1,11 @@
 #include "tcp.h"
+#include "lib/modbus_pdu.h"
 
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
 #include <zephyr/net/socket.h>
-#include <zephyr/modbus/modbus.h>
 
+#include <string.h>
 #include <sys/types.h>
 
 #if CONFIG_OPENP1_TCP
@@ -13,160 +14,492 @@ LOG_MODULE_REGISTER(tcp, LOG_LEVEL_DBG);
 
 #define STACK_SIZE 2048
 #define RECEIVE_THREAD_PRIORITY 8
-#define MAX_CONNECTIONS 8
-
-K_THREAD_STACK_ARRAY_DEFINE(tcp_handler_stack, MAX_CONNECTIONS, STACK_SIZE);
-K_SEM_DEFINE(request_possible, 1, 1);
+#define MAX_CONNECTIONS CONFIG_OPENP1_TCP_MAX_CONNECTIONS
+#define TCP_PIPELINE_DEPTH CONFIG_OPENP1_TCP_PIPELINE_DEPTH
+#define RX_BUFFERS CONFIG_OPENP1_TCP_RX_BUFFERS
+#define LISTEN_BACKLOG 4
+#define IDLE_TIMEOUT_MS (CONFIG_OPENP1_TCP_IDLE_TIMEOUT_S * MSEC_PER_SEC)
+#define POLL_INTERVAL_MS MSEC_PER_SEC
+// A connection holding part of an ADU, or unsent replies, this long is closed,
+// to free its buffer
+#define STALL_TIMEOUT_MS (5 * MSEC_PER_SEC)
+// Connections waiting for a buffer are retried this often
+#define BUFFER_RETRY_MS 50
+// Replies the socket had no room for, a batch and the reply that didn't fit in it
+#define TX_BUFFER_SIZE ROUND_UP(2 * MODBUS_BUFFER_SIZE, 4)
+
+// State of a connection between polls. A receive buffer is only held while
+// part of an ADU, header or body, is still to be received, and a send buffer
+// while replies the socket had no room for are still to be sent. At most
+// RX_BUFFERS connections hold each. Without a free receive buffer, what the
+// client sent is left in the socket until one is.
+struct connection {
+  int sock;
+  uint32_t id;
+  uint8_t *rx;
+  uint16_t rx_len;
+  bool rx_wait;
+  // Unsent replies and the time they last made progress, under connections_lock
+  uint8_t *tx;
+  uint16_t tx_len;
+  int64_t tx_progress;
+  // Set when a long poll reply could not be queued, the server thread closes
+  // the connection
+  bool broken;
+  int64_t last_activity;
+};
+
+// Buffers for replies, held while the connections of one poll round are served
+struct replies {
+  uint8_t *resp;
+  uint8_t *tx;
+  uint16_t tx_len;
+  int transactions;
+};
 
 static struct tcp_server server;
 
-static struct tcp_request request[MAX_CONNECTIONS];
+static struct transport_request request;
 
-static struct k_thread tcp_handler_thread[MAX_CONNECTIONS];
-static int tcp_sockets_in_use[MAX_CONNECTIONS];
-uint8_t recieve_buf[MAX_CONNECTIONS][RECV_BUFFER_SIZE];
+static int tcp_server_reply(const struct transport_request *req, uint8_t *buf, int len);
 
-static int find_free_slot() {
-  for (int i = 0 ; i < MAX_CONNECTIONS ; i++) {
-    if (tcp_sockets_in_use[i] < 0) {
-      return i;
+static const struct transport tcp_transport = {
+  .name = "tcp",
+  .reply = tcp_server_reply,
+  .frame_budget = MODBUS_TCP_FRAME_BUDGET,
+};
+
+static struct connection connections[MAX_CONNECTIONS];
+// Receive buffers held by connections, only used by the server thread
+static int rx_buffers;
+static uint32_t next_connection_id;
+// Taken when opening or closing a connection, and around sends and unsent
+// replies, as long poll replies are sent from another thread
+K_MUTEX_DEFINE(connections_lock);
+
+K_MEM_SLAB_DEFINE_STATIC(tx_slab, TX_BUFFER_SIZE, RX_BUFFERS, 4);
+
+// Listen socket first, followed by one entry per connection
+static struct zsock_pollfd fds[1 + MAX_CONNECTIONS];
+
+// Called with connections_lock held
+static void free_tx(struct connection *conn) {
+  if (conn->tx != NULL) {
+    k_mem_slab_free(&tx_slab, (void **)&conn->tx);
+    conn->tx = NULL;
+  }
+}
+
+// Sends as much of buf as the socket has room for, without waiting, a segment
+// per send. Returns the number of bytes sent, or a negative value on errors.
+static int tcp_server_send(int socket, const uint8_t *buf, int len) {
+  int sent = 0;
+
+  LOG_DBG("Sending reply");
+  while (sent < len) {
+    int ret = send(socket, buf + sent, len - sent, ZSOCK_MSG_DONTWAIT);
+    if (ret < 0 && errno == EAGAIN) {
+      break;
+    } else if (ret <= 0) {
+      LOG_ERR("Failed to send %d after %d of %d bytes", ret < 0 ? errno : 0, sent, len);
+      return ret < 0 ? -errno : -EIO;
     }
+    transport_count_sent(&tcp_transport, ret);
+    sent += ret;
   }
-  return -1;
+  LOG_INF("Sent reply: %d of %d bytes", sent, len);
+  return sent;
 }
 
-static void handle_tcp_connection(void *ptr1, void *ptr2, void *ptr3) {
-  int slot = POINTER_TO_INT(ptr1);
-  int ret = 0;
-  int client = tcp_sockets_in_use[slot];
-  struct modbus_adu adu;
-  uint8_t *buf = request[slot].recv_buffer;
+// Sends buf after the replies still unsent on conn, and keeps what the socket
+// has no room for until POLLOUT. Called with connections_lock held. Returns the
+// number of bytes left unsent, or a negative value to close the connection,
+// also when those outgrow a buffer as the client is not reading its replies.
+static int queue_reply(struct connection *conn, const uint8_t *buf, int len) {
+  int sent = 0;
+
+  if (conn->tx == NULL) {
+    sent = tcp_server_send(conn->sock, buf, len);
+    if (sent < 0 || sent == len) {
+      return MIN(sent, 0);
+    }
+    if (k_mem_slab_alloc(&tx_slab, (void **)&conn->tx, K_NO_WAIT) != 0) {
+      LOG_WRN("No buffer for unsent replies, socket: %d", conn->sock);
+      return -ENOBUFS;
+    }
+    conn->tx_len = 0;
+    conn->tx_progress = k_uptime_get();
+  }
+  if (conn->tx_len + len - sent > TX_BUFFER_SIZE) {
+    LOG_WRN("Too many unsent replies, socket: %d", conn->sock);
+    return -ENOBUFS;
+  }
+  memcpy(conn->tx + conn->tx_len, buf + sent, len - sent);
+  conn->tx_len += len - sent;
+  return conn->tx_len;
+}
 
-  struct timeval receive_timeout = {
-    .tv_sec = 120,
-    .tv_usec = 0,
-  };
-  ret = setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &receive_timeout, sizeof(receive_timeout));
+// Sends the replies the socket had no room for, on POLLOUT. Returns the number
+// of bytes still unsent, or a negative value to close the connection.
+static int send_unsent(struct connection *conn) {
+  k_mutex_lock(&connections_lock, K_FOREVER);
+  int ret = tcp_server_send(conn->sock, conn->tx, conn->tx_len);
+  if (ret > 0) {
+    conn->tx_len -= ret;
+    memmove(conn->tx, conn->tx + ret, conn->tx_len);
+    conn->tx_progress = k_uptime_get();
+  }
+  if (ret >= 0) {
+    ret = conn->tx_len;
+  }
+  if (conn->tx_len == 0) {
+    free_tx(conn);
+  }
+  k_mutex_unlock(&connections_lock);
+  return ret;
+}
 
-  struct timeval send_timeout = {
-    .tv_sec = 10,
-    .tv_usec = 0,
-  };
-  ret = setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &send_timeout, sizeof(send_timeout));
+// Returns the number of bytes left unsent, or a negative value to close the connection
+static int flush_replies(struct connection *conn, struct replies *replies) {
+  int ret = 0;
 
-  LOG_INF("Waiting for TCP packets on port on socket: %d", client);
+  if (replies->tx_len > 0) {
+    LOG_DBG("Sending %d replies", replies->transactions);
+    k_mutex_lock(&connections_lock, K_FOREVER);
+    ret = queue_reply(conn, replies->tx, replies->tx_len);
+    k_mutex_unlock(&connections_lock);
+  }
+  replies->tx_len = 0;
+  replies->transactions = 0;
+  return ret;
+}
 
-  do {
-    ret = recv(client, buf, MODBUS_MBAP_AND_FC_LENGTH, MSG_WAITALL);
-    if (ret != MODBUS_MBAP_AND_FC_LENGTH) {
-      LOG_WRN("Error receiving modbus header, closing socket");
-      break;
+// Takes both reply buffers or neither, so that the server never holds one
+// while waiting for the other
+static bool alloc_replies(struct replies *replies) {
+  replies->resp = modbus_buffer_alloc(K_NO_WAIT);
+  replies->tx = modbus_buffer_alloc(K_NO_WAIT);
+  if (replies->resp == NULL || replies->tx == NULL) {
+    if (replies->resp != NULL) {
+      modbus_buffer_free(replies->resp);
+      replies->resp = NULL;
+    }
+    if (replies->tx != NULL) {
+      modbus_buffer_free(replies->tx);
     }
+    return false;
+  }
+  replies->tx_len = 0;
+  replies->transactions = 0;
+  return true;
+}
+
+static void free_rx(struct connection *conn) {
+  if (conn->rx != NULL) {
+    modbus_buffer_free(conn->rx);
+    conn->rx = NULL;
+    rx_buffers--;
+  }
+}
+
+static void close_connection(struct connection *conn) {
+  free_rx(conn);
+  k_mutex_lock(&connections_lock, K_FOREVER);
+  free_tx(conn);
+  close(conn->sock);
+  conn->sock = -1;
+  conn->broken = false;
+  k_mutex_unlock(&connections_lock);
+}
+
+// Why conn is to be closed, or NULL. Called with connections_lock held.
+static const char *close_reason(const struct connection *conn, int64_t now) {
+  if (conn->broken) {
+    return "a failed reply";
+  } else if (IDLE_TIMEOUT_MS > 0 && now - conn->last_activity > IDLE_TIMEOUT_MS) {
+    return "idle";
+  } else if (conn->rx != NULL && conn->tx == NULL && now - conn->last_activity > STALL_TIMEOUT_MS) {
+    return "stalled ADU";
+  } else if (conn->tx != NULL && now - conn->tx_progress > STALL_TIMEOUT_MS) {
+    return "stalled replies";
+  }
+  return NULL;
+}
 
-    LOG_HEXDUMP_DBG(buf, MODBUS_MBAP_AND_FC_LENGTH , "h:>");
-	  modbus_raw_get_header(&adu, buf);
+// Sends a reply outside of the message handler, if the connection is still open.
+// What the socket has no room for is sent by the server thread, on its next poll.
+// A reply that can't be queued breaks the connection, the client is out of step.
+static int tcp_server_reply(const struct transport_request *req, uint8_t *buf, int len) {
+  int ret = -ENOTCONN;
 
-    ret = recv(client, buf + MODBUS_MBAP_AND_FC_LENGTH, adu.length, MSG_WAITALL);
-    if (ret != adu.length) {
-      LOG_WRN("Error receiving modbus data, closing socket");
+  k_mutex_lock(&connections_lock, K_FOREVER);
+  for (int i = 0 ; i < MAX_CONNECTIONS ; i++) {
+    struct connection *conn = &connections[i];
+    if (conn->sock == req->client.tcp.socket && conn->id == req->client.tcp.connection_id && !conn->broken) {
+      ret = queue_reply(conn, buf, len);
+      conn->broken = ret < 0;
+      ret = MIN(ret, 0);
       break;
     }
-    request[slot].socket = client;
-    request[slot].len = MODBUS_MBAP_AND_FC_LENGTH + adu.length;
+  }
+  k_mutex_unlock(&connections_lock);
+  return ret;
+}
 
-    // Handle request
-    if (server.handler->on_message_recived_cb(&request[slot]) < 0) {
-      LOG_ERR("Failed to handle request");
-      break;
+// Answers every complete ADU in the receive buffer, in the order received. Replies
+// are batched, and flushed when the send buffer is full. Stops after a flush the
+// socket had no room for, the rest is answered once the replies are sent.
+// Returns the number of bytes consumed, or a negative value to close the connection.
+static int process_adus(struct connection *conn, struct replies *replies) {
+  struct modbus_mbap mbap;
+  int pos = 0;
+  int unsent = 0;
+
+  while (unsent == 0 && conn->rx_len - pos >= MODBUS_MBAP_LENGTH) {
+    int adu_len = modbus_mbap_parse(conn->rx + pos, MODBUS_MBAP_LENGTH, &mbap);
+    if (adu_len < 0 || adu_len > MODBUS_BUFFER_SIZE) {
+      LOG_WRN("Invalid modbus header, closing socket");
+      return -EINVAL;
+    }
+    if (conn->rx_len - pos < adu_len) {
+      break; // Rest of the body arrives with a later poll
     }
 
-  } while (true);
+    request.transport = &tcp_transport;
+    request.client.tcp.socket = conn->sock;
+    request.client.tcp.connection_id = conn->id;
+    request.len = adu_len;
+    request.recv_buffer = conn->rx + pos;
+    pos += adu_len;
 
-  close(client);
-  tcp_sockets_in_use[slot] = -1;
+    int len = server.handler->on_message_recived_cb(&request, replies->resp, MODBUS_BUFFER_SIZE);
+    if (len < 0) {
+      LOG_ERR("Failed to handle request");
+      return len;
+    } else if (len == 0) {
+      continue;
+    }
+
+    if (replies->tx_len + len > MODBUS_BUFFER_SIZE || replies->transactions == TCP_PIPELINE_DEPTH) {
+      unsent = flush_replies(conn, replies);
+      if (unsent < 0) {
+        return unsent;
+      }
+    }
+    memcpy(replies->tx + replies->tx_len, replies->resp, len);
+    replies->tx_len += len;
+    replies->transactions++;
+  }
+  return pos;
 }
 
-static int process_connect() {
+// Reads what the client has queued and answers all complete transactions in it,
+// along with those held back while replies were unsent, with as few sends as
+// possible. Returns a negative value to close the connection.
+static int serve_connection(struct connection *conn, struct replies *replies) {
+  int ret;
+
+  conn->rx_wait = false;
+  if (conn->rx == NULL) {
+    conn->rx = rx_buffers < RX_BUFFERS ? modbus_buffer_alloc(K_NO_WAIT) : NULL;
+    conn->rx_wait = conn->rx == NULL;
+    if (conn->rx_wait) {
+      return 0;
+    }
+    conn->rx_len = 0;
+    rx_buffers++;
+  }
+
+  if (conn->rx_len < MODBUS_BUFFER_SIZE) {
+    ret = recv(conn->sock, conn->rx + conn->rx_len, MODBUS_BUFFER_SIZE - conn->rx_len, ZSOCK_MSG_DONTWAIT);
+    if (ret == 0 || (ret < 0 && errno != EAGAIN)) {
+      LOG_INF("Connection closed, socket: %d", conn->sock);
+      return -ENOTCONN;
+    } else if (ret > 0) {
+      LOG_HEXDUMP_DBG(conn->rx + conn->rx_len, ret, "r:>");
+      conn->rx_len += ret;
+      conn->last_activity = k_uptime_get();
+    }
+  }
 
-	struct sockaddr_in6 client_addr;
-	socklen_t client_addr_len = sizeof(client_addr);
+  ret = process_adus(conn, replies);
+  if (ret < 0) {
+    return ret;
+  }
+  conn->rx_len -= ret;
+  memmove(conn->rx, conn->rx + ret, conn->rx_len);
 
-	LOG_INF("Waiting for TCP connection on port %d...", MODBUS_PORT);
+  if (conn->rx_len == 0) {
+    free_rx(conn);
+  }
+  return flush_replies(conn, replies);
+}
 
-	int client = accept(server.sock, (struct sockaddr *)&client_addr, &client_addr_len);
-	if (client < 0) {
-		LOG_ERR("Accept error");
-		return 0;
-	}
+static void accept_connection() {
+  struct sockaddr_in6 client_addr;
+  socklen_t client_addr_len = sizeof(client_addr);
+  struct connection *conn = NULL;
 
-	int slot = find_free_slot();
-	if (slot < 0) {
-		LOG_ERR("Cannot accept more connections");
-		close(client);
-		return 0;
-	}
+  int client = accept(server.sock, (struct sockaddr *)&client_addr, &client_addr_len);
+  if (client < 0) {
+    LOG_ERR("Accept error");
+    return;
+  }
 
-  tcp_sockets_in_use[slot] = client;
+  for (int i = 0 ; i < MAX_CONNECTIONS ; i++) {
+    if (connections[i].sock < 0) {
+      conn = &connections[i];
+      break;
+    }
+  }
+  if (conn == NULL) {
+    LOG_ERR("Cannot accept more connections");
+    close(client);
+    return;
+  }
 
   char buf[128];
   if (net_addr_ntop(AF_INET6, &client_addr.sin6_addr, buf, 128) == NULL) {
     LOG_ERR("Couldn't put address in string");
-    tcp_sockets_in_use[slot] = -1;
-    return 0;
-  } else {
-  	LOG_INF("Accepted connection from %s", buf);
+    close(client);
+    return;
   }
+  LOG_INF("Accepted connection from %s, socket: %d", buf, client);
+
+  k_mutex_lock(&connections_lock, K_FOREVER);
+  conn->sock = client;
+  conn->id = next_connection_id++;
+  conn->tx = NULL;
+  conn->tx_len = 0;
+  k_mutex_unlock(&connections_lock);
+  conn->rx = NULL;
+  conn->rx_len = 0;
+  conn->rx_wait = false;
+  conn->last_activity = k_uptime_get();
+}
 
+// Serves the listen socket and every connection from a single thread
+static void tcp_server_task() {
+  struct replies replies;
 
-  k_thread_create(
-    &tcp_handler_thread[slot],
-    tcp_handler_stack[slot],
-    K_THREAD_STACK_SIZEOF(tcp_handler_stack[slot]),
-    (k_thread_entry_t)handle_tcp_connection,
-    INT_TO_POINTER(slot), NULL, NULL,
-    RECEIVE_THREAD_PRIORITY,
-    0,
-    K_NO_WAIT);
+  LOG_INF("Waiting for TCP connections on port %d...", MODBUS_PORT);
 
-	char name[16];
-  snprintk(name, sizeof(name), "tcp[%d]", slot);
-  k_thread_name_set(&tcp_handler_thread[slot], name);
+  do {
+    int timeout = POLL_INTERVAL_MS;
+
+    fds[0].fd = server.sock;
+    fds[0].events = ZSOCK_POLLIN;
+    k_mutex_lock(&connections_lock, K_FOREVER);
+    for (int i = 0 ; i < MAX_CONNECTIONS ; i++) {
+      fds[1 + i].fd = connections[i].sock; // Negative, unused slots are ignored
+      // Connections with unsent replies wait for room to send them, and are not
+      // read meanwhile. Those waiting for a buffer are only polled for errors,
+      // and retried on timeout. Long poll replies left unsent during the poll
+      // are sent after the next one.
+      if (connections[i].tx != NULL) {
+        fds[1 + i].events = ZSOCK_POLLOUT;
+      } else {
+        fds[1 + i].events = connections[i].rx_wait ? 0 : ZSOCK_POLLIN;
+      }
+      if (connections[i].sock >= 0 && connections[i].rx_wait) {
+        timeout = BUFFER_RETRY_MS;
+      }
+    }
+    k_mutex_unlock(&connections_lock);
 
-  return 0;
-}
+    int ret = zsock_poll(fds, ARRAY_SIZE(fds), timeout);
+    if (ret < 0) {
+      LOG_ERR("Poll error %d", errno);
+      break;
+    }
 
-static void tcp_connection_handler_task() {
-  int ret = 0;
-  do {
-    ret = process_connect();
-  } while (ret == 0);
-  LOG_ERR("Conneciton handler task finished");
-}
+    replies.resp = NULL;
+    for (int i = 0 ; i < MAX_CONNECTIONS ; i++) {
+      struct connection *conn = &connections[i];
+      short revents = fds[1 + i].revents;
+      bool unsent = (fds[1 + i].events & ZSOCK_POLLOUT) != 0;
+
+      if (conn->sock < 0 || (revents == 0 && (unsent || !conn->rx_wait))) {
+        continue;
+      }
+      if ((revents & ~(ZSOCK_POLLIN | ZSOCK_POLLOUT)) != 0 && (revents & ZSOCK_POLLIN) == 0) {
+        LOG_WRN("Error on socket %d, closing", conn->sock);
+        close_connection(conn);
+        continue;
+      }
+      if (revents & ZSOCK_POLLOUT) {
+        ret = send_unsent(conn);
+        if (ret < 0) {
+          close_connection(conn);
+          continue;
+        } else if (ret > 0) {
+          continue;
+        }
+        // Once all is sent, what was held back meanwhile is answered
+        conn->last_activity = k_uptime_get();
+        if (conn->rx == NULL) {
+          continue;
+        }
+      }
+
+      // Without reply buffers the round is skipped, the connection is retried
+      // like one waiting for a receive buffer
+      if (replies.resp == NULL && !alloc_replies(&replies)) {
+        conn->rx_wait = true;
+        continue;
+      }
+      if (serve_connection(conn, &replies) < 0) {
+        replies.tx_len = 0;
+        replies.transactions = 0;
+        close_connection(conn);
+      }
+    }
+    if (replies.resp != NULL) {
+      modbus_buffer_free(replies.resp);
+      modbus_buffer_free(replies.tx);
+    }
 
-int tcp_server_send(int socket, uint8_t *buf, int len) {
-  LOG_DBG("Sending reply");
-  int ret = send(socket, buf, len, 0);
-  if (ret < 0) {
-    LOG_ERR("Failed to send %d", errno);
-    ret = -errno;
-  }
-  LOG_INF("Sent reply: %d bytes", len);
-  return 0;
+    int64_t now = k_uptime_get();
+    for (int i = 0 ; i < MAX_CONNECTIONS ; i++) {
+      if (connections[i].sock < 0) {
+        continue;
+      }
+      k_mutex_lock(&connections_lock, K_FOREVER);
+      const char *reason = close_reason(&connections[i], now);
+      k_mutex_unlock(&connections_lock);
+      if (reason != NULL) {
+        LOG_INF("Closing connection, %s, socket: %d", reason, connections[i].sock);
+        close_connection(&connections[i]);
+      }
+    }
+
+    if (fds[0].revents & ZSOCK_POLLIN) {
+      accept_connection();
+    }
+  } while (true);
+
+  LOG_ERR("TCP server task finished");
 }
 
 K_THREAD_DEFINE(tcp_thread_id, STACK_SIZE,
-    tcp_connection_handler_task, NULL, NULL, NULL,
+    tcp_server_task, NULL, NULL, NULL,
     RECEIVE_THREAD_PRIORITY, 0, -1);
 
-int tcp_server_init(struct tcp_message_handler *handler) {
+int tcp_server_init(struct message_handler *handler) {
 
   int ret;
   server.handler = handler;
   struct sockaddr_in6 addr;
 
   for (int i = 0 ; i < MAX_CONNECTIONS ; i++) {
-    tcp_sockets_in_use[i] = -1;
+    connections[i].sock = -1;
+    connections[i].rx = NULL;
+    connections[i].rx_wait = false;
+    connections[i].tx = NULL;
+    connections[i].tx_len = 0;
+    connections[i].broken = false;
   }
+  rx_buffers = 0;
 
   (void)memset(&addr, 0, sizeof(addr));
   addr.sin6_family = AF_INET6;
@@ -184,13 +517,13 @@ int tcp_server_init(struct tcp_message_handler *handler) {
     ret = -errno;
   }
 
-  ret = listen(server.sock, 1);
+  ret = listen(server.sock, LISTEN_BACKLOG);
   if (ret < 0) {
     LOG_ERR("Failed to listen on socket: %d", errno);
     ret = -errno;
   }
 
-  k_thread_name_set(tcp_thread_id, "tcp connection handler");
+  k_thread_name_set(tcp_thread_id, "tcp");
   k_thread_start(tcp_thread_id);
 
   LOG_INF("Server initialized");
@@ -0,0 +1,61 @@
+#ifndef TRANSPORT_HEADER_H
+#define TRANSPORT_HEADER_H
+
+#include "modbus_buffer.h"
+#include "lib/stats.h"
+
+#include <zephyr/kernel.h>
+#include <zephyr/net/socket.h>
+#include <sys/types.h>
+
+#define MODBUS_PORT 502
+
+struct transport_request;
+
+// One way of receiving Modbus ADUs, e.g. UDP or TCP
+struct transport {
+  const char *name;
+  // Sends a reply outside of the message handler, e.g. to a long poll. Fails
+  // if the client is gone. NULL if replies can only be sent from the handler.
+  int (*reply)(const struct transport_request *req, uint8_t *buf, int len);
+  // Bytes of a datagram or segment fitting one link frame, 0 if replies are
+  // never fragmented
+  uint16_t frame_budget;
+};
+
+// Counts a datagram or segment of len bytes sent by transport against its
+// frame budget. Stream transports count what they send at once, which may
+// batch several replies.
+static inline void transport_count_sent(const struct transport *transport, int len) {
+  if (transport->frame_budget > 0) {
+    stats_increment(len <= transport->frame_budget ? STAT_REPLIES_UNFRAGMENTED : STAT_REPLIES_FRAGMENTED);
+  }
+}
+
+// A request ADU, along with what the transport needs to reply to its client.
+// May be copied to reply later, the receive buffer is only valid in the handler.
+struct transport_request {
+  const struct transport *transport;
+  uint16_t len;
+  uint8_t *recv_buffer;
+  union {
+    struct {
+      struct sockaddr addr;
+      socklen_t addr_len;
+    } udp;
+    struct {
+      int socket;
+      uint32_t connection_id;
+    } tcp;
+  } client;
+};
+
+// Writes the reply to req into resp. Returns its length, 0 for no reply, or a
+// negative value on errors, which close the connection of stream transports.
+typedef int (*on_message_recived_t)(struct transport_request *req, uint8_t *resp, uint16_t resp_size);
+
+struct message_handler {
+  on_message_recived_t on_message_recived_cb;
+};
+
+#endif /* TRANSPORT_HEADER_H */
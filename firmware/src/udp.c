@@ -1,4 +1,5 @@
 #include "udp.h"
+#include "lib/modbus_pdu.h"
 
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
@@ -10,55 +11,95 @@ LOG_MODULE_REGISTER(udp, LOG_LEVEL_DBG);
 
 #define STACK_SIZE 2048
 #define RECEIVE_THREAD_PRIORITY 8
+// Bounded, as the receive buffer of the request is held while waiting
+#define SEND_BUFFER_TIMEOUT K_MSEC(500)
 
-static struct request request;
+// Every datagram gets its own request, so replies go back to its own client
+K_MEM_SLAB_DEFINE_STATIC(request_slab, sizeof(struct transport_request), MAX_OUTSTANDING_REQUESTS, 4);
+K_MSGQ_DEFINE(request_queue, sizeof(struct transport_request *), MAX_OUTSTANDING_REQUESTS, 4);
+
+K_THREAD_STACK_ARRAY_DEFINE(udp_worker_stack, UDP_WORKERS, STACK_SIZE);
+static struct k_thread udp_worker_thread[UDP_WORKERS];
 
 static struct udp_server server;
 
+static int udp_server_send(const struct transport_request *request, uint8_t *buf, int len);
+
+static const struct transport udp_transport = {
+  .name = "udp",
+  .reply = udp_server_send,
+  .frame_budget = MODBUS_FRAME_BUDGET,
+};
+
+static void free_request(struct transport_request *request) {
+  void *block = request;
+
+  modbus_buffer_free(request->recv_buffer);
+  k_mem_slab_free(&request_slab, &block);
+}
+
 static void receive_udp_task()
 {
-  int ret = 0;
   int received;
+  struct transport_request *request;
 
   LOG_INF("Waiting for UDP packets on port %d...", MODBUS_PORT);
 
   do {
-    request.client_addr_len = sizeof(request.client_addr);
-    received = recvfrom(server.sock, request.recv_buffer, RECV_BUFFER_SIZE, MSG_TRUNC,
-			&request.client_addr, &request.client_addr_len);
+    // Blocks while MAX_OUTSTANDING_REQUESTS are being handled
+    k_mem_slab_alloc(&request_slab, (void **) &request, K_FOREVER);
+    request->recv_buffer = modbus_buffer_alloc(K_FOREVER);
+    request->transport = &udp_transport;
+    request->client.udp.addr_len = sizeof(request->client.udp.addr);
+    received = recvfrom(server.sock, request->recv_buffer, MODBUS_BUFFER_SIZE, MSG_TRUNC,
+			&request->client.udp.addr, &request->client.udp.addr_len);
 
     if (received < 0) {
 	    /* Socket error */
 	    LOG_ERR("UDP: Connection error %d", errno);
-	    ret = -errno;
+	    free_request(request);
 	    break;
-    } else if (received > RECV_BUFFER_SIZE) {
+    } else if (received > MODBUS_BUFFER_SIZE) {
       LOG_WRN("UDP: Truncating packet, len: %d", received);
+      free_request(request);
       continue;
     } 
     
     LOG_INF("UDP: Received %d bytes", received);
-    request.len = received;
+    request->len = received;
 
-    // Handle request
-    if (server.handler->on_message_recived_cb(&request) < 0) {
-      continue;
-    }
+    k_msgq_put(&request_queue, &request, K_FOREVER);
+  } while (true);
 
+}
 
-  } while (true);
+static void udp_worker_task(void *ptr1, void *ptr2, void *ptr3) {
+  struct transport_request *request;
 
+  do {
+    k_msgq_get(&request_queue, &request, K_FOREVER);
+    uint8_t *tx_buf = modbus_buffer_alloc(SEND_BUFFER_TIMEOUT);
+    if (tx_buf != NULL) {
+      int len = server.handler->on_message_recived_cb(request, tx_buf, MODBUS_BUFFER_SIZE);
+      if (len > 0) {
+        udp_server_send(request, tx_buf, len);
+      }
+      modbus_buffer_free(tx_buf);
+    } // else dropped, the client will retry
+    free_request(request);
+  } while (true);
 }
 
-int udp_server_send(uint8_t *buf, int len) {
+static int udp_server_send(const struct transport_request *request, uint8_t *buf, int len) {
   LOG_DBG("Sending reply");
-  int ret = sendto(server.sock, buf, len, 0, &request.client_addr, request.client_addr_len);
+  int ret = sendto(server.sock, buf, len, 0, &request->client.udp.addr, request->client.udp.addr_len);
 
   if (ret < 0) {
     LOG_ERR("UDP: Failed to send %d", errno);
-    ret = -errno;
+    return -errno;
   }
   LOG_INF("Sent reply: %d bytes", len);
+  transport_count_sent(&udp_transport, len);
   return 0;
 }
 
@@ -87,6 +128,20 @@ int udp_server_init(struct message_handler *handler) {
     ret = -errno;
   }
 
+  for (int i = 0 ; i < UDP_WORKERS ; i++) {
+    char name[16];
+
+    k_thread_create(&udp_worker_thread[i], udp_worker_stack[i],
+        K_THREAD_STACK_SIZEOF(udp_worker_stack[i]),
+        (k_thread_entry_t)udp_worker_task,
+        NULL, NULL, NULL,
+        RECEIVE_THREAD_PRIORITY,
+        0,
+        K_NO_WAIT);
+    snprintk(name, sizeof(name), "udp[%d]", i);
+    k_thread_name_set(&udp_worker_thread[i], name);
+  }
+
   k_thread_name_set(udp_thread_id, "udp");
   k_thread_start(udp_thread_id);
 
@@ -0,0 +1,71 @@
+#include <regex.h>
+#include "lib/cbor.h"
+
+#include <zephyr/ztest.h>
+
+ZTEST_SUITE(cbor_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct value_store store;
+static uint8_t buf[256];
+
+// Examples of RFC 8949, Appendix A
+ZTEST(cbor_suite, test_rfc_examples)
+{
+	struct cbor_writer writer;
+	const uint8_t expected[] = {
+		0x00, 0x17, 0x18, 0x18, 0x19, 0x03, 0xe8, 0x1a, 0x00, 0x0f, 0x42, 0x40,
+		0x1b, 0x00, 0x00, 0x00, 0xe8, 0xd4, 0xa5, 0x10, 0x00,
+		0x20, 0x38, 0x63, 0x39, 0x03, 0xe7, 0x61, 0x61, 0x80, 0xa0, 0xf6,
+	};
+
+	cbor_writer_init(&writer, buf, sizeof(buf));
+	cbor_put_uint(&writer, 0);
+	cbor_put_uint(&writer, 23);
+	cbor_put_uint(&writer, 24);
+	cbor_put_int(&writer, 1000);
+	cbor_put_int(&writer, 1000000);
+	cbor_put_uint(&writer, 1000000000000);
+	cbor_put_int(&writer, -1);
+	cbor_put_int(&writer, -100);
+	cbor_put_int(&writer, -1000);
+	cbor_put_text(&writer, "a", 1);
+	cbor_put_array(&writer, 0);
+	cbor_put_map(&writer, 0);
+	cbor_put_null(&writer);
+	zassert_equal(cbor_writer_finish(&writer), sizeof(expected));
+	zassert_mem_equal(buf, expected, sizeof(expected));
+
+	cbor_writer_init(&writer, buf, 2);
+	cbor_put_int(&writer, 1000);
+	zassert_equal(cbor_writer_finish(&writer), -ENOMEM);
+}
+
+ZTEST(cbor_suite, test_item_and_snapshot)
+{
+	struct data_item energy_in = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 1000 }};
+	struct data_item date_time = { DATE_TIME, { .date_time = "230101120000W" }};
+	// {"v": 1000, "e": -3}
+	const uint8_t item[] = { 0xa2, 0x61, 'v', 0x19, 0x03, 0xe8, 0x61, 'e', 0x22 };
+	// {"v": null, "e": -3}
+	const uint8_t stale[] = { 0xa2, 0x61, 'v', 0xf6, 0x61, 'e', 0x22 };
+	// {"g": 5, "t": "230101120000W", "v": {1: 1000}}
+	const uint8_t snapshot[] = {
+		0xa3, 0x61, 'g', 0x05, 0x61, 't', 0x6d, '2', '3', '0', '1', '0', '1', '1', '2', '0', '0', '0', '0', 'W',
+		0x61, 'v', 0xa1, 0x01, 0x19, 0x03, 0xe8,
+	};
+
+	value_store_init(&store);
+	value_store_update(&store, &energy_in);
+	value_store_update(&store, &date_time);
+	store.generation = 5;
+
+	zassert_equal(cbor_encode_item(&store, METER_ACTIVE_ENERGY_IN, buf, sizeof(buf)), sizeof(item));
+	zassert_mem_equal(buf, item, sizeof(item));
+	zassert_equal(cbor_encode_item(&store, METER_ACTIVE_ENERGY_OUT, buf, sizeof(buf)), sizeof(stale));
+	zassert_mem_equal(buf, stale, sizeof(stale));
+	zassert_equal(cbor_encode_item(&store, DATE_TIME, buf, sizeof(buf)), -EINVAL);
+
+	zassert_equal(cbor_encode_snapshot(&store, buf, sizeof(buf)), sizeof(snapshot));
+	zassert_mem_equal(buf, snapshot, sizeof(snapshot));
+	zassert_equal(cbor_encode_snapshot(&store, buf, 8), -ENOMEM);
+}
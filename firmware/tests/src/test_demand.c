@@ -0,0 +1,75 @@
+#include <regex.h>
+#include "lib/demand.h"
+
+#include <zephyr/ztest.h>
+
+ZTEST_SUITE(demand_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct demand_tracker tracker;
+static struct demand_result result;
+
+ZTEST(demand_suite, test_parse_date_time)
+{
+	uint16_t month;
+	uint32_t second;
+
+	zassert_equal(demand_parse_date_time("210222161900W", &month, &second), 0);
+	zassert_equal(month, 21 * 12 + 1);
+	zassert_equal(second, (21 * 24 + 16) * 3600 + 19 * 60);
+	zassert_equal(demand_parse_date_time("211322161900W", &month, &second), -EINVAL);
+	zassert_equal(demand_parse_date_time("2102221619", &month, &second), -EINVAL);
+}
+
+ZTEST(demand_suite, test_running_average_and_projection)
+{
+	demand_init(&tracker);
+	zassert_equal(demand_update(&tracker, "230301000000W", 10000, 4000, &result), 0);
+	// 500 Wh in 5 minutes is 6 kW on average
+	zassert_equal(demand_update(&tracker, "230301000500W", 10500, 3000, &result), 0);
+	zassert_equal(result.average, 6000);
+	// Remaining 10 minutes at 3 kW adds 500 Wh, 1 kWh per quarter is 4 kW
+	zassert_equal(result.projected, 4000);
+	zassert_false(result.peak_valid);
+}
+
+ZTEST(demand_suite, test_month_peak_needs_complete_interval)
+{
+	demand_init(&tracker);
+	// Started mid-interval, not counted
+	demand_update(&tracker, "230301000700W", 10000, -1, &result);
+	demand_update(&tracker, "230301001500W", 12000, -1, &result);
+	zassert_false(result.peak_valid);
+
+	// 250 Wh in a quarter is 1 kW
+	demand_update(&tracker, "230301003000W", 12250, -1, &result);
+	zassert_true(result.peak_valid);
+	zassert_equal(result.month_peak, 1000);
+
+	// 750 Wh is 3 kW, new peak
+	demand_update(&tracker, "230301004500W", 13000, -1, &result);
+	zassert_equal(result.month_peak, 3000);
+
+	// Lower quarter keeps the peak
+	demand_update(&tracker, "230301010000W", 13100, -1, &result);
+	zassert_equal(result.month_peak, 3000);
+
+	// Gap of several intervals, next one is partial
+	demand_update(&tracker, "230301020000W", 15000, -1, &result);
+	demand_update(&tracker, "230301021500W", 20000, -1, &result);
+	zassert_equal(result.month_peak, 3000);
+}
+
+ZTEST(demand_suite, test_month_rollover_resets_peak)
+{
+	demand_init(&tracker);
+	demand_update(&tracker, "230331232000W", 9000, -1, &result);
+	demand_update(&tracker, "230331233000W", 10000, -1, &result);
+	demand_update(&tracker, "230331234500W", 11000, -1, &result);
+	zassert_equal(result.month_peak, 4000);
+
+	demand_update(&tracker, "230401000000S", 11500, -1, &result);
+	zassert_false(result.peak_valid);
+	demand_update(&tracker, "230401001500S", 11600, -1, &result);
+	zassert_true(result.peak_valid);
+	zassert_equal(result.month_peak, 400);
+}
@@ -0,0 +1,121 @@
+#include <regex.h>
+#include "lib/derived.h"
+#include "lib/value_store.h"
+
+#include <zephyr/ztest.h>
+
+ZTEST_SUITE(derived_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct sliding_window window;
+
+ZTEST(derived_suite, test_window_min_max_mean)
+{
+	int32_t values[] = { 5, 3, 8, 1, 9, 2 };
+
+	sliding_window_init(&window);
+	for (int i = 0 ; i < sizeof(values) / sizeof(*values) ; i++) {
+		sliding_window_push(&window, i * 1000, values[i]);
+	}
+	zassert_equal(sliding_window_count(&window), 6);
+	zassert_equal(sliding_window_min(&window), 1);
+	zassert_equal(sliding_window_max(&window), 9);
+	zassert_equal(sliding_window_mean(&window), 5); // 28 / 6 rounded
+}
+
+ZTEST(derived_suite, test_window_expires_by_time)
+{
+	sliding_window_init(&window);
+	sliding_window_push(&window, 0, 100);
+	sliding_window_push(&window, 1000, 1);
+	sliding_window_push(&window, DERIVED_WINDOW_MS, 50);
+
+	zassert_equal(sliding_window_count(&window), 2);
+	zassert_equal(sliding_window_max(&window), 50);
+	zassert_equal(sliding_window_min(&window), 1);
+}
+
+ZTEST(derived_suite, test_window_matches_brute_force)
+{
+	int32_t values[4 * DERIVED_WINDOW_SAMPLES];
+
+	sliding_window_init(&window);
+	for (int i = 0 ; i < sizeof(values) / sizeof(*values) ; i++) {
+		values[i] = (i * 7919) % 1000;
+		sliding_window_push(&window, i, values[i]);
+
+		int first = MAX(0, i - DERIVED_WINDOW_SAMPLES + 1);
+		int32_t min = values[first], max = values[first];
+		for (int j = first ; j <= i ; j++) {
+			min = MIN(min, values[j]);
+			max = MAX(max, values[j]);
+		}
+		zassert_equal(sliding_window_count(&window), i - first + 1);
+		zassert_equal(sliding_window_min(&window), min);
+		zassert_equal(sliding_window_max(&window), max);
+	}
+}
+
+ZTEST(derived_suite, test_ewma_converges)
+{
+	struct derived_metrics metrics;
+	const struct derived_definition *ewma = &derived_definition_table[0];
+	int64_t value;
+
+	zassert_equal(derived_metrics_init(&metrics), 0);
+	zassert_equal(ewma->aggregate, AGGREGATE_EWMA);
+	zassert_equal(derived_metrics_get(&metrics, ewma, &value), -ENODATA);
+
+	derived_metrics_push(&metrics, ACTIVE_ENERGY_IN, 0, 1000);
+	zassert_equal(derived_metrics_get(&metrics, ewma, &value), 0);
+	zassert_equal(value, 1000);
+
+	for (int i = 1 ; i < 200 ; i++) {
+		derived_metrics_push(&metrics, ACTIVE_ENERGY_IN, i * 1000, 2000);
+	}
+	zassert_equal(derived_metrics_get(&metrics, ewma, &value), 0);
+	zassert_within(value, 2000, 8);
+}
+
+static struct value_store store;
+
+static void apply(uint32_t in, uint32_t out) {
+	struct telegram *telegram = telegram_init();
+	struct data_item items[] = {
+		{ ACTIVE_ENERGY_IN, { .double_long_unsigned = in }},
+		{ ACTIVE_ENERGY_OUT, { .double_long_unsigned = out }},
+	};
+	for (int i = 0 ; i < sizeof(items) / sizeof(*items) ; i++) {
+		telegram_item_append(telegram, &items[i]);
+	}
+	value_store_apply(&store, telegram);
+	telegram_free(telegram);
+}
+
+ZTEST(derived_suite, test_virtual_items_in_value_store)
+{
+	zassert_equal(value_store_init(&store), 0);
+	apply(1500, 0);
+	apply(500, 200);
+	apply(1000, 0);
+
+	struct value_store_read_result result = value_store_read(&store, ACTIVE_ENERGY_IN_MAX);
+	zassert_equal(result.status, OK);
+	zassert_equal(result.data.data.value.double_long_unsigned, 1500);
+
+	result = value_store_read(&store, ACTIVE_ENERGY_IN_MIN);
+	zassert_equal(result.data.data.value.double_long_unsigned, 500);
+
+	result = value_store_read(&store, ACTIVE_ENERGY_IN_MEAN);
+	zassert_equal(result.data.data.value.double_long_unsigned, 1000);
+
+	result = value_store_read(&store, NET_ACTIVE_ENERGY);
+	zassert_equal(result.status, OK);
+	zassert_equal(result.data.data.value.double_long_signed, 1000);
+
+	apply(0, 700);
+	result = value_store_read(&store, NET_ACTIVE_ENERGY);
+	zassert_equal(result.data.data.value.double_long_signed, -700);
+
+	// Meter counters were never received
+	zassert_equal(value_store_read(&store, METER_NET_ACTIVE_ENERGY).status, STALE);
+}
@@ -0,0 +1,73 @@
+#include <regex.h>
+#include "lib/history.h"
+
+#include <zephyr/ztest.h>
+
+ZTEST_SUITE(history_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct history history;
+static struct history_sample samples[HISTORY_DEPTH];
+
+ZTEST(history_suite, test_zigzag_varint)
+{
+	int64_t values[] = { 0, 1, -1, 63, -64, 64, 300, -300, INT32_MAX, INT64_MIN, INT64_MAX };
+	uint8_t buf[10];
+
+	for (int i = 0 ; i < sizeof(values) / sizeof(*values) ; i++) {
+		int64_t decoded;
+		int len = zigzag_varint_encode(values[i], buf);
+		zassert_equal(zigzag_varint_decode(buf, len, &decoded), len);
+		zassert_equal(decoded, values[i]);
+	}
+
+	zassert_equal(zigzag_varint_encode(-64, buf), 1);
+	zassert_equal(zigzag_varint_encode(64, buf), 2);
+	zassert_equal(zigzag_varint_decode(buf, 1, &values[0]), -1);
+}
+
+ZTEST(history_suite, test_empty)
+{
+	history_init(&history);
+	zassert_equal(history_count(&history), 0);
+	zassert_equal(history_read(&history, 0, samples, HISTORY_DEPTH), 0);
+}
+
+ZTEST(history_suite, test_read_since)
+{
+	history_init(&history);
+	for (int i = 1 ; i <= 10 ; i++) {
+		history_append(&history, i * 1000, 5000 - i * 7);
+	}
+	zassert_equal(history_count(&history), 10);
+
+	zassert_equal(history_read(&history, 0, samples, HISTORY_DEPTH), 10);
+	for (int i = 0 ; i < 10 ; i++) {
+		zassert_equal(samples[i].timestamp, (i + 1) * 1000);
+		zassert_equal(samples[i].value, 5000 - (i + 1) * 7);
+	}
+
+	zassert_equal(history_read(&history, 7000, samples, HISTORY_DEPTH), 3);
+	zassert_equal(samples[0].timestamp, 8000);
+	zassert_equal(history_read(&history, 0, samples, 2), 2);
+	zassert_equal(samples[1].timestamp, 2000);
+	zassert_equal(history_read(&history, 10000, samples, HISTORY_DEPTH), 0);
+}
+
+ZTEST(history_suite, test_wraps_keeping_newest)
+{
+	history_init(&history);
+	for (int i = 0 ; i < 10 * HISTORY_DEPTH ; i++) {
+		// Alternate large and small deltas to exercise ring wrap of variable length records
+		int64_t value = (i % 2) ? 3000000000 + i : i;
+		history_append(&history, 1000 + i * 997, value);
+	}
+	int count = history_read(&history, 0, samples, HISTORY_DEPTH);
+	zassert_equal(count, history_count(&history));
+	zassert_true(count > 1 && count <= HISTORY_DEPTH);
+
+	for (int j = 0 ; j < count ; j++) {
+		int i = 10 * HISTORY_DEPTH - count + j;
+		zassert_equal(samples[j].timestamp, 1000 + i * 997);
+		zassert_equal(samples[j].value, (i % 2) ? 3000000000 + i : i);
+	}
+}
@@ -0,0 +1,147 @@
+#include <regex.h>
+#include "modbus.h"
+#include "transport.h"
+#include "watchdog.h"
+#include "state_indicator.h"
+#include "lib/register_map.h"
+#include "lib/modbus_pdu.h"
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+// Simulated time stands still while threads run, requests/s take host time
+#include <native_rtc.h>
+
+#define CLIENTS 8
+#define REQUESTS 2000
+#define TELEGRAMS 200
+#define STACK_SIZE 2048
+#define READ_REGISTERS (DATA_ITEM_REGISTERS + 2)
+#define ENERGY_ADDRESS (DATA_BASE_ADDRESS + METER_ACTIVE_ENERGY_IN * DATA_ITEM_REGISTERS)
+
+static struct value_store store;
+
+// The transports run on the board only, modbus.c reports activity to these
+void watchdog_feed(enum watchdog dog) {
+}
+
+void state_indicator_set_state(enum indicator_state state) {
+}
+
+static void *modbus_setup(void)
+{
+	value_store_init(&store);
+	modbus_server_init(&store);
+	return NULL;
+}
+
+ZTEST_SUITE(modbus_suite, NULL, modbus_setup, NULL, NULL, NULL);
+
+// Replies are sent from the handler only, like RTU, so long polls are never parked
+static const struct transport test_transport = {
+	.name = "test",
+};
+
+K_THREAD_STACK_ARRAY_DEFINE(client_stacks, CLIENTS, STACK_SIZE);
+static struct k_thread client_threads[CLIENTS];
+static int client_errors[CLIENTS];
+static int client_changes[CLIENTS];
+K_THREAD_STACK_DEFINE(writer_stack, STACK_SIZE);
+static struct k_thread writer_thread;
+
+static void apply(uint32_t energy)
+{
+	struct telegram *telegram = telegram_init();
+	struct data_item energy_in = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = energy }};
+	struct data_item energy_out = { METER_ACTIVE_ENERGY_OUT, { .double_long_unsigned = energy }};
+
+	zassert_not_null(telegram);
+	telegram_item_append(telegram, &energy_in);
+	telegram_item_append(telegram, &energy_out);
+	value_store_apply(&store, telegram);
+	telegram_free(telegram);
+}
+
+static void writer(void *p1, void *p2, void *p3)
+{
+	for (int i = 2 ; i <= TELEGRAMS ; i++) {
+		apply(i);
+		k_yield();
+	}
+}
+
+// Each client reads energy in and the start of energy out, with holding and input
+// registers in turn. Every reply must answer its own transaction, and both values
+// must come from the same telegram.
+static void client(void *p1, void *p2, void *p3)
+{
+	int id = POINTER_TO_INT(p1);
+	uint8_t req[MODBUS_MBAP_LENGTH + 5];
+	uint8_t resp[MODBUS_BUFFER_SIZE];
+	uint32_t last = 0;
+
+	for (int i = 0 ; i < REQUESTS ; i++) {
+		uint16_t trans_id = (id << 12) | (i & 0xfff);
+		uint8_t fc = (i % 2) ? MODBUS_FC_READ_INPUT_REGISTERS : MODBUS_FC_READ_HOLDING_REGISTERS;
+		struct transport_request request = {
+			.transport = &test_transport,
+			.len = sizeof(req),
+			.recv_buffer = req,
+		};
+
+		sys_put_be16(trans_id, &req[0]);
+		sys_put_be16(0, &req[2]);
+		sys_put_be16(6, &req[4]);
+		req[6] = 1;
+		req[7] = fc;
+		sys_put_be16(ENERGY_ADDRESS, &req[8]);
+		sys_put_be16(READ_REGISTERS, &req[10]);
+
+		int len = modbus_on_message_received(&request, resp, sizeof(resp));
+		const uint8_t *data = &resp[MODBUS_MBAP_LENGTH + 2];
+		uint32_t energy_in = sys_get_be32(&data[0]);
+
+		if (len != MODBUS_MBAP_LENGTH + 2 + READ_REGISTERS * 2 ||
+		    sys_get_be16(&resp[0]) != trans_id || resp[7] != fc || resp[8] != READ_REGISTERS * 2 ||
+		    sys_get_be16(&data[DATA_STATUS_OFFSET * 2]) != DATA_STATUS_FRESH ||
+		    energy_in != sys_get_be32(&data[DATA_ITEM_REGISTERS * 2]) || energy_in < last) {
+			client_errors[id]++;
+		}
+		if (energy_in != last) {
+			client_changes[id]++;
+			last = energy_in;
+		}
+		k_yield();
+	}
+}
+
+// The clients and the writer take turns at the same priority, so requests
+// interleave with each other and with telegrams
+ZTEST(modbus_suite, test_concurrent_clients)
+{
+	apply(1);
+
+	int64_t start = native_rtc_gettime_us(RTC_CLOCK_REALTIME);
+	for (int i = 0 ; i < CLIENTS ; i++) {
+		client_errors[i] = 0;
+		client_changes[i] = 0;
+		k_thread_create(&client_threads[i], client_stacks[i], STACK_SIZE, client,
+				INT_TO_POINTER(i), NULL, NULL, K_PRIO_PREEMPT(1), 0, K_NO_WAIT);
+	}
+	k_thread_create(&writer_thread, writer_stack, STACK_SIZE, writer,
+			NULL, NULL, NULL, K_PRIO_PREEMPT(1), 0, K_NO_WAIT);
+
+	for (int i = 0 ; i < CLIENTS ; i++) {
+		k_thread_join(&client_threads[i], K_FOREVER);
+	}
+	int64_t elapsed_us = native_rtc_gettime_us(RTC_CLOCK_REALTIME) - start;
+	k_thread_join(&writer_thread, K_FOREVER);
+
+	for (int i = 0 ; i < CLIENTS ; i++) {
+		zassert_equal(client_errors[i], 0, "client %d", i);
+		// Requests overlapped telegrams, not just the first or the last
+		zassert_true(client_changes[i] > 1, "client %d", i);
+	}
+	// Requests serialize on the store lock, see process_request() in modbus.c
+	TC_PRINT("%d clients, %d requests in %lld ms, %lld requests/s\n", CLIENTS, CLIENTS * REQUESTS,
+		 elapsed_us / USEC_PER_MSEC, (int64_t)CLIENTS * REQUESTS * USEC_PER_SEC / MAX(elapsed_us, 1));
+}
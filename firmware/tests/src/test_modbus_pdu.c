@@ -0,0 +1,142 @@
+#include <regex.h>
+#include "lib/modbus_pdu.h"
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+
+ZTEST_SUITE(modbus_pdu_suite, NULL, NULL, NULL, NULL, NULL);
+
+static int counting_reader(void *ctx, uint16_t addr, uint16_t count, uint8_t *dst) {
+	if (addr >= 0x100) {
+		return MODBUS_EXC_ILLEGAL_DATA_ADDRESS;
+	}
+	for (int i = 0 ; i < count ; i++) {
+		sys_put_be16(addr + i, &dst[i * 2]);
+	}
+	return 0;
+}
+
+static int read_handler(void *ctx, const uint8_t *req, uint16_t req_len, uint8_t *resp, uint16_t resp_size) {
+	return modbus_pdu_read_registers(req, req_len, resp, resp_size, counting_reader, ctx);
+}
+
+static const struct modbus_fc_entry table[] = {
+	{ MODBUS_FC_READ_INPUT_REGISTERS, read_handler },
+};
+
+static const struct modbus_pdu_engine engine = {
+	.table = table,
+	.table_len = 1,
+	.unit_id = 1,
+};
+
+static uint8_t resp[MODBUS_MAX_ADU_LENGTH];
+
+ZTEST(modbus_pdu_suite, test_mbap_parse)
+{
+	struct modbus_mbap mbap;
+	uint8_t header[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x06, 0x01 };
+
+	zassert_equal(modbus_mbap_parse(header, sizeof(header), &mbap), 12);
+	zassert_equal(mbap.trans_id, 0x1234);
+	zassert_equal(mbap.unit_id, 1);
+	zassert_equal(modbus_mbap_parse(header, 6, &mbap), -EINVAL);
+
+	header[5] = 0xff;
+	zassert_equal(modbus_mbap_parse(header, sizeof(header), &mbap), -EINVAL);
+}
+
+ZTEST(modbus_pdu_suite, test_read_input_registers)
+{
+	uint8_t req[] = { 0xab, 0xcd, 0x00, 0x00, 0x00, 0x06, 0x01, 0x04, 0x00, 0x10, 0x00, 0x03 };
+	uint8_t expected[] = { 0xab, 0xcd, 0x00, 0x00, 0x00, 0x09, 0x01, 0x04, 0x06,
+			       0x00, 0x10, 0x00, 0x11, 0x00, 0x12 };
+
+	int len = modbus_pdu_process(&engine, NULL, req, sizeof(req), resp, sizeof(resp));
+	zassert_equal(len, sizeof(expected));
+	zassert_mem_equal(resp, expected, sizeof(expected));
+}
+
+ZTEST(modbus_pdu_suite, test_exceptions)
+{
+	uint8_t illegal_function[] = { 0, 1, 0, 0, 0, 6, 1, 0x06, 0, 0, 0, 1 };
+	uint8_t illegal_address[] = { 0, 2, 0, 0, 0, 6, 1, 0x04, 0x01, 0, 0, 1 };
+	uint8_t illegal_count[] = { 0, 3, 0, 0, 0, 6, 1, 0x04, 0, 0, 0, 126 };
+
+	zassert_equal(modbus_pdu_process(&engine, NULL, illegal_function, 12, resp, sizeof(resp)), 9);
+	zassert_equal(resp[7], 0x86);
+	zassert_equal(resp[8], MODBUS_EXC_ILLEGAL_FUNCTION);
+
+	zassert_equal(modbus_pdu_process(&engine, NULL, illegal_address, 12, resp, sizeof(resp)), 9);
+	zassert_equal(resp[1], 2);
+	zassert_equal(resp[5], 3);
+	zassert_equal(resp[7], 0x84);
+	zassert_equal(resp[8], MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+
+	zassert_equal(modbus_pdu_process(&engine, NULL, illegal_count, 12, resp, sizeof(resp)), 9);
+	zassert_equal(resp[8], MODBUS_EXC_ILLEGAL_DATA_VALUE);
+}
+
+ZTEST(modbus_pdu_suite, test_response_too_large)
+{
+	uint8_t req[] = { 0, 1, 0, 0, 0, 6, 1, 0x04, 0, 0, 0, 12 };
+
+	// 7 + 2 + 24 bytes does not fit a 32 byte buffer
+	zassert_equal(modbus_pdu_process(&engine, NULL, req, sizeof(req), resp, 32), 9);
+	zassert_equal(resp[8], MODBUS_EXC_SERVER_DEVICE_FAILURE);
+	req[11] = 11;
+	zassert_equal(modbus_pdu_process(&engine, NULL, req, sizeof(req), resp, 32), 31);
+}
+
+ZTEST(modbus_pdu_suite, test_other_unit_and_malformed)
+{
+	uint8_t other_unit[] = { 0, 1, 0, 0, 0, 6, 7, 0x04, 0, 0, 0, 1 };
+	uint8_t tcp_unit[] = { 0, 1, 0, 0, 0, 6, 0xff, 0x04, 0, 0, 0, 1 };
+	uint8_t truncated[] = { 0, 1, 0, 0, 0, 6, 1, 0x04, 0, 0 };
+	uint8_t bad_protocol[] = { 0, 1, 0, 1, 0, 6, 1, 0x04, 0, 0, 0, 1 };
+
+	zassert_equal(modbus_pdu_process(&engine, NULL, other_unit, 12, resp, sizeof(resp)), 0);
+	zassert_equal(modbus_pdu_process(&engine, NULL, tcp_unit, 12, resp, sizeof(resp)), 11);
+	zassert_equal(modbus_pdu_process(&engine, NULL, truncated, 10, resp, sizeof(resp)), -EINVAL);
+	zassert_equal(modbus_pdu_process(&engine, NULL, bad_protocol, 12, resp, sizeof(resp)), -EINVAL);
+}
+
+ZTEST(modbus_pdu_suite, test_long_poll)
+{
+	uint8_t req[] = { MODBUS_FC_LONG_POLL, 0x00, 0x10, 0x00, 0x02, 0x00, 0x00, 0x00, 0x07, 0x00, 0x05 };
+	uint8_t out[16];
+
+	zassert_equal(modbus_pdu_long_poll(req, sizeof(req), out, sizeof(out), 7, true, counting_reader, NULL),
+		      MODBUS_PDU_DEFERRED);
+
+	// Answered once the generation moved on, or when it can't be deferred any more
+	zassert_equal(modbus_pdu_long_poll(req, sizeof(req), out, sizeof(out), 8, true, counting_reader, NULL), 10);
+	zassert_equal(out[0], MODBUS_FC_LONG_POLL);
+	zassert_equal(out[1], 8);
+	zassert_equal(sys_get_be32(&out[2]), 8);
+	zassert_equal(sys_get_be16(&out[6]), 0x10);
+	zassert_equal(sys_get_be16(&out[8]), 0x11);
+	zassert_equal(modbus_pdu_long_poll(req, sizeof(req), out, sizeof(out), 7, false, counting_reader, NULL), 10);
+
+	zassert_equal(modbus_pdu_long_poll(req, sizeof(req) - 1, out, sizeof(out), 8, true, counting_reader, NULL),
+		      -MODBUS_EXC_ILLEGAL_DATA_VALUE);
+	req[3] = 0x01;
+	zassert_equal(modbus_pdu_long_poll(req, sizeof(req), out, sizeof(out), 8, true, counting_reader, NULL),
+		      -MODBUS_EXC_ILLEGAL_DATA_VALUE);
+}
+
+ZTEST(modbus_pdu_suite, test_read_registers_fitting)
+{
+	uint8_t req[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00 };
+	uint8_t resp[MODBUS_MAX_ADU_LENGTH];
+	uint16_t count = modbus_read_registers_fitting(64);
+
+	zassert_equal(count, 27);
+	sys_put_be16(count, &req[10]);
+	zassert_equal(modbus_pdu_process(&engine, NULL, req, sizeof(req), resp, sizeof(resp)), 63);
+	sys_put_be16(count + 1, &req[10]);
+	zassert_equal(modbus_pdu_process(&engine, NULL, req, sizeof(req), resp, sizeof(resp)), 65);
+
+	zassert_equal(modbus_read_registers_fitting(10), 0);
+	zassert_equal(modbus_read_registers_fitting(1000), MODBUS_MAX_READ_REGISTERS);
+}
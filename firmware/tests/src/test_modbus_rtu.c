@@ -0,0 +1,48 @@
+#include <regex.h>
+#include "lib/modbus_rtu.h"
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+
+ZTEST_SUITE(modbus_rtu_suite, NULL, NULL, NULL, NULL, NULL);
+
+ZTEST(modbus_rtu_suite, test_crc)
+{
+	uint8_t frame[] = { 0x01, 0x04, 0x00, 0x00, 0x00, 0x01, 0x31, 0xca };
+
+	zassert_equal(modbus_rtu_crc(frame, 6), 0xca31);
+	zassert_equal(modbus_rtu_crc(frame, sizeof(frame)), 0); // Residue of a valid frame
+}
+
+ZTEST(modbus_rtu_suite, test_frame_gap)
+{
+	zassert_equal(modbus_rtu_frame_gap_us(9600), 4011);
+	zassert_equal(modbus_rtu_frame_gap_us(19200), 2006);
+	zassert_equal(modbus_rtu_frame_gap_us(115200), 1750);
+}
+
+ZTEST(modbus_rtu_suite, test_round_trip)
+{
+	uint8_t frame[] = { 0x01, 0x04, 0x08, 0x00, 0x00, 0x02, 0x00, 0x00 };
+	uint8_t adu[MODBUS_MAX_ADU_LENGTH];
+	uint8_t resp_adu[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x01, 0x04, 0x04, 0x00, 0x01, 0xe2, 0x40 };
+	uint8_t resp[MODBUS_RTU_MAX_FRAME_LENGTH];
+
+	sys_put_le16(modbus_rtu_crc(frame, 6), &frame[6]);
+	zassert_equal(modbus_rtu_to_adu(frame, sizeof(frame), adu, sizeof(adu)), MODBUS_MBAP_LENGTH + 5);
+	zassert_equal(sys_get_be16(&adu[4]), 6);
+	zassert_equal(adu[6], 0x01);
+	zassert_mem_equal(&adu[7], &frame[1], 5);
+
+	zassert_equal(modbus_rtu_from_adu(resp_adu, sizeof(resp_adu), resp, sizeof(resp)), 9);
+	zassert_mem_equal(resp, &resp_adu[6], 7);
+	zassert_equal(modbus_rtu_crc(resp, 9), 0);
+
+	// Corrupted and broadcast frames
+	frame[3] ^= 1;
+	zassert_equal(modbus_rtu_to_adu(frame, sizeof(frame), adu, sizeof(adu)), -EINVAL);
+	frame[3] ^= 1;
+	frame[0] = MODBUS_RTU_BROADCAST_ADDRESS;
+	sys_put_le16(modbus_rtu_crc(frame, 6), &frame[6]);
+	zassert_equal(modbus_rtu_to_adu(frame, sizeof(frame), adu, sizeof(adu)), 0);
+}
@@ -0,0 +1,58 @@
+#include <regex.h>
+#include "lib/mqtt_sn.h"
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+
+ZTEST_SUITE(mqtt_sn_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct value_store store;
+static uint8_t buf[64];
+
+ZTEST(mqtt_sn_suite, test_session_messages)
+{
+	struct mqtt_sn_message msg;
+	static const uint8_t connack[] = { 3, MQTT_SN_CONNACK, 0x03 };
+	static const uint8_t pingresp[] = { 2, MQTT_SN_PINGRESP };
+
+	zassert_equal(mqtt_sn_encode_connect(buf, sizeof(buf), "blep1", 60), 11);
+	zassert_mem_equal(buf, "\x0b\x04\x04\x01\x00\x3c" "blep1", 11);
+	zassert_equal(mqtt_sn_encode_connect(buf, 8, "blep1", 60), -ENOMEM);
+	zassert_equal(mqtt_sn_encode_pingreq(buf, sizeof(buf)), 2);
+	zassert_mem_equal(buf, "\x02\x16", 2);
+	zassert_equal(mqtt_sn_encode_disconnect(buf, sizeof(buf)), 2);
+	zassert_mem_equal(buf, "\x02\x18", 2);
+
+	zassert_equal(mqtt_sn_parse(connack, sizeof(connack), &msg), 0);
+	zassert_equal(msg.type, MQTT_SN_CONNACK);
+	zassert_equal(msg.return_code, 0x03);
+	zassert_equal(mqtt_sn_parse(pingresp, sizeof(pingresp), &msg), 0);
+	zassert_equal(msg.type, MQTT_SN_PINGRESP);
+	zassert_equal(mqtt_sn_parse(connack, 2, &msg), -EINVAL);
+}
+
+ZTEST(mqtt_sn_suite, test_publish)
+{
+	struct data_item energy = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 123456 }};
+	struct data_item power = { ACTIVE_ENERGY_IN, { .double_long_unsigned = 250 }};
+	struct data_item net = { NET_ACTIVE_ENERGY, { .double_long_signed = -1500 }};
+
+	memcpy(&buf[MQTT_SN_PUBLISH_HEADER_LENGTH], "abc", 3);
+	zassert_equal(mqtt_sn_encode_publish(buf, sizeof(buf), 0x0102, 3), 10);
+	zassert_mem_equal(buf, "\x0a\x0c\x01\x01\x02\x00\x00" "abc", 10);
+	zassert_equal(mqtt_sn_encode_publish(buf, sizeof(buf), 1, sizeof(buf)), -ENOMEM);
+
+	value_store_init(&store);
+	value_store_update(&store, &energy);
+	value_store_update(&store, &power);
+	value_store_update(&store, &net);
+	zassert_equal(mqtt_sn_encode_item(&store, METER_ACTIVE_ENERGY_IN, 257, buf, sizeof(buf)), 14);
+	zassert_equal(sys_get_be16(&buf[3]), 257);
+	zassert_mem_equal(&buf[MQTT_SN_PUBLISH_HEADER_LENGTH], "123.456", 7);
+	zassert_equal(mqtt_sn_encode_item(&store, ACTIVE_ENERGY_IN, 1, buf, sizeof(buf)), 12);
+	zassert_mem_equal(&buf[MQTT_SN_PUBLISH_HEADER_LENGTH], "0.250", 5);
+	zassert_equal(mqtt_sn_encode_item(&store, NET_ACTIVE_ENERGY, 1, buf, sizeof(buf)), 13);
+	zassert_mem_equal(&buf[MQTT_SN_PUBLISH_HEADER_LENGTH], "-1.500", 6);
+	zassert_equal(mqtt_sn_encode_item(&store, DATE_TIME, 1, buf, sizeof(buf)), -EINVAL);
+	zassert_equal(mqtt_sn_encode_item(&store, ACTIVE_ENERGY_IN, 1, buf, 10), -ENOMEM);
+}
@@ -12,3 +12,13 @@ ZTEST(openp1_suite, test_definitions_for_all_items) {
 	}
 }
 
+
+ZTEST(openp1_suite, test_virtual_items_have_no_obis) {
+	for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+		zassert_equal(IS_VIRTUAL_ITEM(i), data_definition_table[i].obis == NULL);
+	}
+	for (int i = 0 ; i < derived_definition_count ; i++) {
+		zassert_true(IS_VIRTUAL_ITEM(derived_definition_table[i].item));
+		zassert_false(IS_VIRTUAL_ITEM(derived_definition_table[i].source));
+	}
+}
@@ -64,3 +64,32 @@ ZTEST(telegram_parsing_suite, test_landis_gyr_e360) {
 	parser_free(parser);
 	telegram_framer_free(framer);
 }
+
+// Frames are shared with raw telegram subscribers, parsing must leave them as received
+ZTEST(telegram_parsing_suite, test_frame_is_not_modified) {
+	const char *test_data =
+		"/ASD5id123\r\n\r\n"
+		"1-0:1.8.0(00006678.394*kWh)\r\n"
+		"1-0:1.7.0(0001.023*kW)\r\n"
+		"!6FCA\r\n";
+	struct telegram_framer *framer = telegram_framer_init();
+	struct net_buf *buf = NULL;
+	zassert_not_null(framer);
+	for (int i = 0 ; i < strlen(test_data) ; i++) {
+		buf = telegram_framer_push(framer, test_data[i]);
+	}
+	zassert_not_null(buf);
+	zassert_equal(buf->len, strlen(test_data));
+	zassert_mem_equal(buf->data, test_data, buf->len);
+
+	struct parser *parser = parser_init();
+	struct telegram *telegram = parse_telegram(parser, buf);
+	zassert_not_null(telegram);
+	zassert_equal(telegram_items_count(telegram), 2);
+	zassert_mem_equal(buf->data, test_data, buf->len);
+
+	telegram_free(telegram);
+	net_buf_unref(buf);
+	parser_free(parser);
+	telegram_framer_free(framer);
+}
@@ -0,0 +1,55 @@
+#include <regex.h>
+#include "persistence.h"
+#include "lib/value_store.h"
+
+#include <zephyr/ztest.h>
+
+ZTEST_SUITE(persistence_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct value_store store;
+static struct value_store rebooted;
+
+static void set(enum Item item, int64_t value) {
+	struct data_item data = { .item = item };
+	data_item_set_numeric_value(&data, value);
+	value_store_update(&store, &data);
+}
+
+// Saves to the flash simulator and loads into another store, as after a reboot.
+// Flash may hold snapshots of earlier runs, so the store is compared to itself.
+ZTEST(persistence_suite, test_save_and_restore)
+{
+	struct history_sample saved[HISTORY_DEPTH], loaded[HISTORY_DEPTH];
+	int64_t value, age;
+
+	value_store_init(&store);
+	zassert_ok(persistence_init(&store));
+	value_store_init(&store);
+	set(METER_ACTIVE_ENERGY_IN, 12345678);
+	set(METER_ACTIVE_ENERGY_IN, 12345679);
+	set(ACTIVE_ENERGY_IN, 1234);
+	k_sleep(K_MSEC(100));
+	zassert_true(persistence_save(&store) >= 0);
+
+	value_store_init(&rebooted);
+	zassert_ok(persistence_init(&rebooted));
+
+	zassert_ok(data_item_numeric_value(&rebooted.rows[METER_ACTIVE_ENERGY_IN].data, &value));
+	zassert_equal(value, 12345679);
+	zassert_ok(data_item_numeric_value(&rebooted.rows[ACTIVE_ENERGY_IN].data, &value));
+	zassert_equal(value, 1234);
+	zassert_equal(rebooted.rows[METER_ACTIVE_ENERGY_OUT].last_updated, NEVER_UPDATED);
+	age = k_uptime_get() - rebooted.rows[ACTIVE_ENERGY_IN].last_updated;
+	zassert_true(age >= 100);
+
+	int count = value_store_read_history(&store, METER_ACTIVE_ENERGY_IN, INT64_MIN, saved, HISTORY_DEPTH);
+	zassert_equal(value_store_read_history(&rebooted, METER_ACTIVE_ENERGY_IN, INT64_MIN, loaded, HISTORY_DEPTH),
+		      count);
+	zassert_equal(loaded[count - 1].value, 12345679);
+
+	// Restored values are never fresh, and read as restored until the meter sends them again
+	zassert_false(value_store_is_fresh(&rebooted, METER_ACTIVE_ENERGY_IN));
+	zassert_false(value_store_is_fresh(&rebooted, ACTIVE_ENERGY_IN));
+	zassert_true(value_store_is_restored(&rebooted, ACTIVE_ENERGY_IN));
+	zassert_equal(value_store_read(&rebooted, ACTIVE_ENERGY_IN).status, STALE);
+}
@@ -0,0 +1,145 @@
+#include <regex.h>
+#include "lib/push.h"
+
+#include <zephyr/ztest.h>
+
+ZTEST_SUITE(push_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct value_store store;
+static struct push_state state;
+static struct snapshot snapshot;
+static uint8_t buf[64];
+
+static const struct push_config config = {
+	.min_interval_ms = 1000,
+	.full_interval_ms = 60000,
+	.deadband = 10,
+};
+
+static void set(enum Item item, uint32_t value) {
+	struct data_item data = { item, { .double_long_unsigned = value }};
+	value_store_update(&store, &data);
+}
+
+ZTEST(push_suite, test_changed_items)
+{
+	int len;
+
+	value_store_init(&store);
+	push_init(&state);
+	zassert_equal(push_collect(&state, &config, &store, 0), 0);
+
+	set(METER_ACTIVE_ENERGY_IN, 123456);
+	set(ACTIVE_ENERGY_IN, 1500);
+	store.generation = 7;
+	zassert_equal(push_collect(&state, &config, &store, 0), 2);
+	len = push_encode(&state, &store, buf, sizeof(buf));
+	zassert_equal(len, SNAPSHOT_HEADER_LENGTH + 4 + 3);
+	zassert_equal(snapshot_decode(buf, len, NULL, &snapshot), 0);
+	zassert_equal(snapshot.flags, SNAPSHOT_FLAG_FULL);
+	zassert_equal(snapshot.generation, 7);
+	zassert_equal(snapshot.items, BIT64(METER_ACTIVE_ENERGY_IN) | BIT64(ACTIVE_ENERGY_IN));
+	zassert_equal(snapshot.rows[METER_ACTIVE_ENERGY_IN].data.value.double_long_unsigned, 123456);
+	zassert_equal(snapshot.rows[ACTIVE_ENERGY_IN].data.value.double_long_unsigned, 1500);
+	zassert_equal(push_encode(&state, &store, buf, sizeof(buf)), 0);
+
+	// Rate limited, then within the deadband
+	set(ACTIVE_ENERGY_IN, 1600);
+	zassert_equal(push_collect(&state, &config, &store, 500), 0);
+	set(ACTIVE_ENERGY_IN, 1510);
+	zassert_equal(push_collect(&state, &config, &store, 1000), 0);
+
+	// Counters relative to the full round
+	set(ACTIVE_ENERGY_IN, 1511);
+	set(METER_ACTIVE_ENERGY_IN, 123500);
+	store.generation = 8;
+	zassert_equal(push_collect(&state, &config, &store, 2000), 2);
+	len = push_encode(&state, &store, buf, sizeof(buf));
+	zassert_equal(len, SNAPSHOT_DELTA_HEADER_LENGTH + 2 + 3);
+	zassert_equal(buf[SNAPSHOT_DELTA_HEADER_LENGTH], METER_ACTIVE_ENERGY_IN | SNAPSHOT_RECORD_DELTA);
+	zassert_equal(snapshot_decode(buf, len, NULL, &snapshot), 0);
+	zassert_equal(snapshot.flags, SNAPSHOT_FLAG_DELTA);
+	zassert_equal(snapshot.base_generation, 7);
+	zassert_equal(snapshot.unresolved, BIT64(METER_ACTIVE_ENERGY_IN));
+	zassert_equal(snapshot_decode(buf, len, &state.base, &snapshot), 0);
+	zassert_equal(snapshot.items, BIT64(METER_ACTIVE_ENERGY_IN) | BIT64(ACTIVE_ENERGY_IN));
+	zassert_equal(snapshot.rows[METER_ACTIVE_ENERGY_IN].data.value.double_long_unsigned, 123500);
+	zassert_equal(snapshot.rows[ACTIVE_ENERGY_IN].data.value.double_long_unsigned, 1511);
+
+	// Committed without encoding
+	set(ACTIVE_ENERGY_IN, 1600);
+	zassert_equal(push_collect(&state, &config, &store, 3000), 1);
+	push_commit(&state, &store);
+	zassert_equal(state.pending, 0);
+	zassert_equal(push_collect(&state, &config, &store, 4000), 0);
+
+	// Full round after the interval, whether changed or not
+	zassert_equal(push_collect(&state, &config, &store, 60000), 2);
+}
+
+ZTEST(push_suite, test_round_split_into_datagrams)
+{
+	value_store_init(&store);
+	push_init(&state);
+	for (enum Item item = METER_ACTIVE_ENERGY_IN ; item <= REACTIVE_ENERGY_OUT ; item++) {
+		set(item, item);
+	}
+
+	zassert_equal(push_collect(&state, &config, &store, 0), 8);
+	// Small values take two bytes per record
+	zassert_equal(push_encode(&state, &store, buf, SNAPSHOT_HEADER_LENGTH), -ENOMEM);
+	zassert_equal(push_encode(&state, &store, buf, SNAPSHOT_HEADER_LENGTH + 5 * 2),
+		      SNAPSHOT_HEADER_LENGTH + 5 * 2);
+	zassert_equal(buf[2], SNAPSHOT_FLAG_FULL | SNAPSHOT_FLAG_MORE);
+	zassert_equal(push_encode(&state, &store, buf, SNAPSHOT_HEADER_LENGTH + 5 * 2),
+		      SNAPSHOT_HEADER_LENGTH + 3 * 2);
+	zassert_equal(buf[2], SNAPSHOT_FLAG_FULL);
+	zassert_equal(buf[8], ACTIVE_ENERGY_OUT);
+	zassert_equal(push_encode(&state, &store, buf, sizeof(buf)), 0);
+
+	zassert_equal(push_collect(&state, &config, &store, 1000), 0);
+}
+
+ZTEST(push_suite, test_round_restarted_by_telegram)
+{
+	value_store_init(&store);
+	push_init(&state);
+	for (enum Item item = METER_ACTIVE_ENERGY_IN ; item <= REACTIVE_ENERGY_OUT ; item++) {
+		set(item, item);
+	}
+	uint64_t rest;
+	int len;
+
+	// A full round starts over with the new generation
+	zassert_equal(push_collect(&state, &config, &store, 0), 8);
+	zassert_equal(push_encode(&state, &store, buf, SNAPSHOT_HEADER_LENGTH + 5 * 2),
+		      SNAPSHOT_HEADER_LENGTH + 5 * 2);
+	set(METER_ACTIVE_ENERGY_IN, 100);
+	store.generation++;
+	len = push_encode(&state, &store, buf, sizeof(buf));
+	zassert_equal(snapshot_decode(buf, len, NULL, &snapshot), 0);
+	zassert_equal(snapshot.generation, store.generation);
+	zassert_equal(snapshot.flags, SNAPSHOT_FLAG_FULL);
+	zassert_equal(snapshot.items, state.published);
+	zassert_equal(snapshot.rows[METER_ACTIVE_ENERGY_IN].data.value.double_long_unsigned, 100);
+	zassert_equal(state.base.generation, store.generation);
+	zassert_equal(push_encode(&state, &store, buf, sizeof(buf)), 0);
+
+	// A delta round sends the rest with the new generation
+	for (enum Item item = METER_ACTIVE_ENERGY_IN ; item <= REACTIVE_ENERGY_OUT ; item++) {
+		set(item, item + 1000);
+	}
+	zassert_equal(push_collect(&state, &config, &store, 1000), 8);
+	zassert_true(push_encode(&state, &store, buf, SNAPSHOT_DELTA_HEADER_LENGTH + 3 * 3) > 0);
+	rest = state.pending;
+	zassert_true(rest & BIT64(REACTIVE_ENERGY_OUT));
+	set(REACTIVE_ENERGY_OUT, 2000);
+	store.generation++;
+	len = push_encode(&state, &store, buf, sizeof(buf));
+	zassert_equal(snapshot_decode(buf, len, &state.base, &snapshot), 0);
+	zassert_equal(snapshot.generation, store.generation);
+	zassert_equal(snapshot.base_generation, state.base.generation);
+	zassert_equal(snapshot.items, rest);
+	zassert_equal(snapshot.rows[REACTIVE_ENERGY_OUT].data.value.double_long_unsigned, 2000);
+	zassert_equal(push_encode(&state, &store, buf, sizeof(buf)), 0);
+}
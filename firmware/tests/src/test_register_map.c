@@ -0,0 +1,320 @@
+#include <regex.h>
+#include <math.h>
+#include "lib/register_map.h"
+#include "lib/modbus_pdu.h"
+#include "lib/stats.h"
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+
+ZTEST_SUITE(register_map_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct value_store store;
+static uint8_t regs[MODBUS_MAX_READ_REGISTERS * 2];
+
+#define ITEM_ADDRESS(item) (DATA_BASE_ADDRESS + (item) * DATA_ITEM_REGISTERS)
+#define HISTORY_ADDRESS(item) (HISTORY_BASE_ADDRESS + (item) * HISTORY_ITEM_REGISTERS)
+
+ZTEST(register_map_suite, test_read_item)
+{
+	struct data_item energy = { METER_ACTIVE_ENERGY_OUT, { .double_long_unsigned = 0x00010002 }};
+	int64_t now = k_uptime_get();
+
+	value_store_init(&store);
+	value_store_update(&store, &energy);
+
+	zassert_equal(register_map_read_input(&store, now, ITEM_ADDRESS(METER_ACTIVE_ENERGY_OUT), 2, regs), 0);
+	zassert_equal(sys_get_be16(&regs[0]), 1);
+	zassert_equal(sys_get_be16(&regs[2]), 2);
+
+	zassert_equal(register_map_read_input(&store, now, ITEM_ADDRESS(METER_ACTIVE_ENERGY_OUT), 3, regs),
+		      MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+	zassert_equal(register_map_read_input(&store, now, ITEM_ADDRESS(METER_ACTIVE_ENERGY_IN), 2, regs),
+		      MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+	zassert_equal(register_map_read_input(&store, now, 0x0100, 1, regs), MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+}
+
+ZTEST(register_map_suite, test_read_history_newest_first)
+{
+	struct data_item power = { ACTIVE_ENERGY_IN, { .double_long_unsigned = 0 }};
+	int64_t now = k_uptime_get();
+
+	value_store_init(&store);
+	for (int i = 1 ; i <= 3 ; i++) {
+		power.value.double_long_unsigned = i * 100;
+		value_store_update(&store, &power);
+	}
+
+	// Skip the first register, read into the missing 4th sample
+	zassert_equal(register_map_read_input(&store, now + 1500, HISTORY_ADDRESS(ACTIVE_ENERGY_IN) + 1, 15, regs), 0);
+	zassert_equal(sys_get_be16(&regs[0]), 1500);
+	zassert_equal(sys_get_be32(&regs[2]), 300);
+	zassert_equal(sys_get_be32(&regs[6 + 4]), 200);
+	zassert_equal(sys_get_be32(&regs[14 + 4]), 100);
+	zassert_equal(sys_get_be32(&regs[22]), 0xffffffff);
+}
+
+ZTEST(register_map_suite, test_read_history_across_items)
+{
+	value_store_init(&store);
+	uint16_t addr = HISTORY_ADDRESS(ACTIVE_ENERGY_OUT) - 2;
+
+	zassert_equal(register_map_read_input(&store, 0, addr, 4, regs), 0);
+	zassert_equal(sys_get_be32(&regs[0]), 0xffffffff);
+	zassert_equal(register_map_read_input(&store, 0, HISTORY_ADDRESS(_ITEM_COUNT) - 1, 2, regs),
+		      MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+}
+
+ZTEST(register_map_suite, test_read_across_items)
+{
+	struct data_item energy_in = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 0x00030004 }};
+	struct data_item reactive_in = { METER_REACTIVE_ENERGY_IN, { .double_long_unsigned = 0x00050006 }};
+	uint16_t addr = ITEM_ADDRESS(METER_ACTIVE_ENERGY_IN);
+
+	value_store_init(&store);
+	value_store_update(&store, &energy_in);
+	value_store_update(&store, &reactive_in);
+
+	// Energy in, stale energy out and the first half of reactive in
+	zassert_equal(register_map_read_input(&store, 0, addr, 2 * DATA_ITEM_REGISTERS + 1, regs), 0);
+	zassert_equal(sys_get_be32(&regs[0]), 0x00030004);
+	zassert_equal(sys_get_be16(&regs[2 * 2]), 0);
+	zassert_equal(sys_get_be16(&regs[DATA_STATUS_OFFSET * 2]), 1);
+	zassert_equal(sys_get_be32(&regs[DATA_ITEM_REGISTERS * 2]), 0);
+	zassert_equal(sys_get_be16(&regs[(DATA_ITEM_REGISTERS + DATA_STATUS_OFFSET) * 2]), 0);
+	zassert_equal(sys_get_be16(&regs[2 * DATA_ITEM_REGISTERS * 2]), 0x0005);
+}
+
+ZTEST(register_map_suite, test_status_register)
+{
+	value_store_init(&store);
+	zassert_equal(register_map_read_input(&store, 0, ITEM_ADDRESS(DATE_TIME) + DATA_STATUS_OFFSET, 1, regs), 0);
+	zassert_equal(sys_get_be16(&regs[0]), 0);
+
+	// Past the last item
+	zassert_equal(register_map_read_input(&store, 0, ITEM_ADDRESS(_ITEM_COUNT - 1), DATA_ITEM_REGISTERS + 1, regs),
+		      MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+}
+
+ZTEST(register_map_suite, test_read_restored)
+{
+	struct data_item energy = { METER_ACTIVE_ENERGY_OUT, { .double_long_unsigned = 0x00010002 }};
+	int64_t now = k_uptime_get();
+	uint16_t addr = ITEM_ADDRESS(METER_ACTIVE_ENERGY_OUT);
+
+	// Saved 3 s after the update, restored right after boot
+	value_store_init(&store);
+	value_store_update(&store, &energy);
+	value_store_rebase_rows(store.rows, _ITEM_COUNT, -(now + 3000));
+	value_store_restore(&store, now);
+
+	zassert_equal(register_map_read_input(&store, now, addr, 2, regs), 0);
+	zassert_equal(sys_get_be32(&regs[0]), 0x00010002);
+	zassert_equal(register_map_read_input(&store, now, addr + DATA_STATUS_OFFSET, 1, regs), 0);
+	zassert_equal(sys_get_be16(&regs[0]), DATA_STATUS_RESTORED);
+	zassert_equal(register_map_read_input(&store, now + 250, SYSTEM_DATA_AGE, 2, regs), 0);
+	zassert_equal(sys_get_be32(&regs[0]), 3250);
+
+	// Clients asking for fresh values don't get them
+	zassert_equal(register_map_read_fresh_input(&store, now, addr, 2, regs), MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+	zassert_equal(register_map_read_fresh_input(&store, now, addr, DATA_ITEM_REGISTERS, regs), MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+	zassert_equal(register_map_read_fresh_input(&store, now, addr - 1, 2, regs), 0);
+	zassert_equal(sys_get_be16(&regs[2]), 0);
+
+	value_store_update(&store, &energy);
+	zassert_equal(register_map_read_fresh_input(&store, now, addr, 2, regs), 0);
+	zassert_equal(register_map_read_input(&store, now, addr + DATA_STATUS_OFFSET, 1, regs), 0);
+	zassert_equal(sys_get_be16(&regs[0]), DATA_STATUS_FRESH);
+}
+
+#define READERS 4
+#define TELEGRAMS 200
+#define STACK_SIZE 2048
+
+K_THREAD_STACK_ARRAY_DEFINE(reader_stacks, READERS, STACK_SIZE);
+static struct k_thread reader_threads[READERS];
+static int reader_reads[READERS];
+static int reader_errors[READERS];
+// Reads that saw another telegram than the previous read of the same reader
+static int reader_changes[READERS];
+static atomic_t writer_done;
+K_THREAD_STACK_DEFINE(writer_stack, STACK_SIZE);
+static struct k_thread writer_thread;
+
+// Energy in and out are always applied with the same value, a read spanning both
+// must never observe one telegram for energy in and another for energy out
+static void reader(void *p1, void *p2, void *p3)
+{
+	int id = POINTER_TO_INT(p1);
+	uint8_t buf[(DATA_ITEM_REGISTERS + 2) * 2];
+	uint32_t last = 0;
+
+	while (!atomic_get(&writer_done)) {
+		value_store_lock(&store);
+		int exc = register_map_read_input(&store, k_uptime_get(), ITEM_ADDRESS(METER_ACTIVE_ENERGY_IN),
+						  DATA_ITEM_REGISTERS + 2, buf);
+		value_store_unlock(&store);
+
+		uint32_t energy_in = sys_get_be32(&buf[0]);
+		if (exc != 0 || energy_in != sys_get_be32(&buf[DATA_ITEM_REGISTERS * 2])) {
+			reader_errors[id]++;
+		}
+		if (energy_in != last) {
+			reader_changes[id]++;
+			last = energy_in;
+		}
+		reader_reads[id]++;
+		k_yield();
+	}
+}
+
+static void writer(void *p1, void *p2, void *p3)
+{
+	for (int i = 1 ; i <= TELEGRAMS ; i++) {
+		struct telegram *telegram = telegram_init();
+		struct data_item energy_in = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = i }};
+		struct data_item energy_out = { METER_ACTIVE_ENERGY_OUT, { .double_long_unsigned = i }};
+
+		zassert_not_null(telegram);
+		telegram_item_append(telegram, &energy_in);
+		telegram_item_append(telegram, &energy_out);
+		value_store_apply(&store, telegram);
+		telegram_free(telegram);
+		k_yield();
+	}
+	atomic_set(&writer_done, true);
+}
+
+// The writer takes turns with the readers at the same priority, so they run
+// between and during telegrams, and every reader must see telegrams change
+// under it. Nobody sleeps: simulated time stands still while threads run.
+ZTEST(register_map_suite, test_concurrent_readers)
+{
+	value_store_init(&store);
+	atomic_set(&writer_done, false);
+
+	for (int i = 0 ; i < READERS ; i++) {
+		reader_reads[i] = 0;
+		reader_errors[i] = 0;
+		reader_changes[i] = 0;
+		k_thread_create(&reader_threads[i], reader_stacks[i], STACK_SIZE, reader,
+				INT_TO_POINTER(i), NULL, NULL, K_PRIO_PREEMPT(1), 0, K_NO_WAIT);
+	}
+	k_thread_create(&writer_thread, writer_stack, STACK_SIZE, writer,
+			NULL, NULL, NULL, K_PRIO_PREEMPT(1), 0, K_NO_WAIT);
+	k_thread_join(&writer_thread, K_FOREVER);
+
+	for (int i = 0 ; i < READERS ; i++) {
+		k_thread_join(&reader_threads[i], K_FOREVER);
+		zassert_equal(reader_errors[i], 0);
+		// Reads overlapped many writes, not just the first or the last
+		zassert_true(reader_changes[i] > 1);
+		zassert_true(reader_reads[i] >= reader_changes[i]);
+	}
+}
+
+ZTEST(register_map_suite, test_system_registers)
+{
+	struct data_item energy = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 1 }};
+	struct telegram *telegram = telegram_init();
+	uint32_t requests = stats_get(STAT_MODBUS_REQUESTS);
+	int64_t now = k_uptime_get();
+
+	value_store_init(&store);
+	zassert_equal(register_map_read_input(&store, now, 0, SYSTEM_REGISTERS, regs), 0);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_TELEGRAMS * 2]), 0);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_DATA_AGE * 2]), UINT32_MAX);
+
+	zassert_not_null(telegram);
+	telegram_item_append(telegram, &energy);
+	value_store_apply(&store, telegram);
+	telegram_free(telegram);
+	stats_increment(STAT_MODBUS_REQUESTS);
+
+	zassert_equal(register_map_read_input(&store, now + 250, 0, SYSTEM_REGISTERS, regs), 0);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_GENERATION * 2]), store.generation);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_TELEGRAMS * 2]), 1);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_DATA_AGE * 2]), 250);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_TELEGRAM_INTERVAL * 2]), 0);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_MODBUS_REQUESTS * 2]), requests + 1);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_FRAME_BUDGET * 2]), MODBUS_FRAME_BUDGET);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_FRAME_REGISTERS * 2]), (MODBUS_FRAME_BUDGET - 9) / 2);
+	zassert_equal(sys_get_be32(&regs[SYSTEM_TCP_FRAME_REGISTERS * 2]), (MODBUS_TCP_FRAME_BUDGET - 9) / 2);
+
+	zassert_equal(register_map_read_input(&store, now, SYSTEM_REGISTERS - 1, 2, regs),
+		      MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+}
+
+ZTEST(register_map_suite, test_sunspec_block)
+{
+	static const struct sunspec_identity identity = { "OpenP1", "blep1", "1", "sn", 1 };
+	struct data_item energy_in = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 123456 }};
+	struct data_item power_in = { ACTIVE_ENERGY_IN, { .double_long_unsigned = 40000 }};
+	struct data_item power_out = { ACTIVE_ENERGY_OUT, { .double_long_unsigned = 0 }};
+	uint16_t meter = SUNSPEC_METER_ADDRESS;
+
+	value_store_init(&store);
+	value_store_update(&store, &energy_in);
+	value_store_update(&store, &power_in);
+	value_store_update(&store, &power_out);
+
+	register_map_enable_sunspec(&identity);
+	zassert_equal(register_map_read_input(&store, 0, SUNSPEC_BASE_ADDRESS, 6, regs), 0);
+	zassert_mem_equal(regs, "SunS", 4);
+	zassert_equal(sys_get_be16(&regs[4]), SUNSPEC_COMMON_MODEL);
+	zassert_equal(sys_get_be16(&regs[6]), SUNSPEC_COMMON_LENGTH);
+	zassert_mem_equal(&regs[8], "Op", 2);
+
+	// 40 kW doesn't fit an int16 in W
+	zassert_equal(register_map_read_input(&store, 0, meter - 2, 2 + SUNSPEC_METER_LENGTH, regs), 0);
+	zassert_equal(sys_get_be16(&regs[0]), SUNSPEC_METER_MODEL);
+	zassert_equal(sys_get_be16(&regs[2]), SUNSPEC_METER_LENGTH);
+	zassert_equal(sys_get_be16(&regs[(2 + SUNSPEC_W) * 2]), 4000);
+	zassert_equal((int16_t) sys_get_be16(&regs[(2 + SUNSPEC_W_SF) * 2]), 1);
+	zassert_equal(sys_get_be16(&regs[(2 + SUNSPEC_VAR) * 2]), 0x8000);
+	zassert_equal(sys_get_be32(&regs[(2 + SUNSPEC_TOT_WH_IMP) * 2]), 123456);
+	zassert_equal(sys_get_be32(&regs[(2 + SUNSPEC_TOT_WH_EXP) * 2]), 0);
+
+	// End model is the last register pair
+	zassert_equal(register_map_read_input(&store, 0, SUNSPEC_BASE_ADDRESS + SUNSPEC_REGISTERS - 2, 2, regs), 0);
+	zassert_equal(sys_get_be16(&regs[0]), SUNSPEC_END_MODEL);
+	zassert_equal(register_map_read_input(&store, 0, SUNSPEC_BASE_ADDRESS + SUNSPEC_REGISTERS - 1, 2, regs),
+		      MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+}
+
+ZTEST(register_map_suite, test_dense_windows)
+{
+	struct data_item energy_in = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 123456 }};
+	struct data_item power_in = { ACTIVE_ENERGY_IN, { .double_long_unsigned = 1500 }};
+	int items = register_map_dense_items();
+	float value;
+
+	value_store_init(&store);
+	value_store_update(&store, &energy_in);
+	value_store_update(&store, &power_in);
+	value_store_expire(&store);
+
+	// All numeric items, the date string excluded, fit a single read
+	zassert_equal(items, _ITEM_COUNT - 1);
+	zassert_true(items * 2 <= MODBUS_MAX_READ_REGISTERS);
+
+	register_map_enable_dense();
+	zassert_equal(register_map_read_input(&store, 0, DENSE_INT32_BASE_ADDRESS, items * 2, regs), 0);
+	zassert_equal(sys_get_be32(&regs[0]), 123456);
+	zassert_equal(sys_get_be32(&regs[4]), (uint32_t) INT32_MIN); // Stale
+	zassert_equal(sys_get_be32(&regs[(ACTIVE_ENERGY_IN - 1) * 4]), 1500);
+
+	zassert_equal(register_map_read_input(&store, 0, DENSE_FLOAT32_BASE_ADDRESS, items * 2, regs), 0);
+	uint32_t bits = sys_get_be32(&regs[(ACTIVE_ENERGY_IN - 1) * 4]);
+	memcpy(&value, &bits, sizeof(value));
+	zassert_within(value, 1.5f, 0.0001f);
+	bits = sys_get_be32(&regs[4]);
+	memcpy(&value, &bits, sizeof(value));
+	zassert_true(isnan(value));
+
+	// Second half of a value, and past the last item
+	zassert_equal(register_map_read_input(&store, 0, DENSE_INT32_BASE_ADDRESS + 1, 1, regs), 0);
+	zassert_equal(sys_get_be16(regs), 123456 & 0xffff);
+	zassert_equal(register_map_read_input(&store, 0, DENSE_INT32_BASE_ADDRESS + items * 2 - 1, 2, regs),
+		      MODBUS_EXC_ILLEGAL_DATA_ADDRESS);
+}
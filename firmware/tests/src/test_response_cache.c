@@ -0,0 +1,85 @@
+#include <regex.h>
+#include "lib/response_cache.h"
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+
+ZTEST_SUITE(response_cache_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct response_cache cache;
+static uint8_t resp[MODBUS_MAX_ADU_LENGTH];
+
+static bool below_0x100(uint8_t fc, uint16_t addr, uint16_t count) {
+	return addr + count <= 0x100;
+}
+
+static void read_request(uint8_t *req, uint16_t trans_id, uint16_t addr, uint16_t count) {
+	uint8_t header[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x01, 0x04 };
+
+	memcpy(req, header, sizeof(header));
+	sys_put_be16(trans_id, &req[0]);
+	sys_put_be16(addr, &req[8]);
+	sys_put_be16(count, &req[10]);
+}
+
+ZTEST(response_cache_suite, test_hit_patches_transaction_id)
+{
+	uint8_t req[RESPONSE_CACHE_REQUEST_LENGTH];
+	uint8_t encoded[] = { 0x12, 0x34, 0x00, 0x00, 0x00, 0x05, 0x01, 0x04, 0x02, 0xab, 0xcd };
+
+	response_cache_init(&cache, below_0x100);
+	read_request(req, 0x1234, 0x10, 1);
+	zassert_equal(response_cache_lookup(&cache, 1, req, sizeof(req), resp, sizeof(resp)), 0);
+	response_cache_store(&cache, 1, req, sizeof(req), encoded, sizeof(encoded));
+
+	read_request(req, 0x5678, 0x10, 1);
+	zassert_equal(response_cache_lookup(&cache, 1, req, sizeof(req), resp, sizeof(resp)), sizeof(encoded));
+	zassert_equal(sys_get_be16(&resp[0]), 0x5678);
+	zassert_mem_equal(&resp[2], &encoded[2], sizeof(encoded) - 2);
+	zassert_equal(cache.hits, 1);
+	zassert_equal(cache.misses, 1);
+}
+
+ZTEST(response_cache_suite, test_new_generation_misses)
+{
+	uint8_t req[RESPONSE_CACHE_REQUEST_LENGTH];
+	uint8_t encoded[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x01, 0x04, 0x02, 0xab, 0xcd };
+
+	response_cache_init(&cache, below_0x100);
+	read_request(req, 1, 0x10, 1);
+	response_cache_store(&cache, 1, req, sizeof(req), encoded, sizeof(encoded));
+	zassert_equal(response_cache_lookup(&cache, 2, req, sizeof(req), resp, sizeof(resp)), 0);
+
+	// Other range, and one that isn't cacheable
+	response_cache_store(&cache, 2, req, sizeof(req), encoded, sizeof(encoded));
+	read_request(req, 1, 0x11, 1);
+	zassert_equal(response_cache_lookup(&cache, 2, req, sizeof(req), resp, sizeof(resp)), 0);
+	read_request(req, 1, 0x200, 1);
+	response_cache_store(&cache, 2, req, sizeof(req), encoded, sizeof(encoded));
+	zassert_equal(response_cache_lookup(&cache, 2, req, sizeof(req), resp, sizeof(resp)), 0);
+	zassert_equal(cache.misses, 2);
+}
+
+ZTEST(response_cache_suite, test_evicts_least_recently_used)
+{
+	uint8_t req[RESPONSE_CACHE_REQUEST_LENGTH];
+	uint8_t encoded[] = { 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x01, 0x04, 0x02, 0xab, 0xcd };
+
+	response_cache_init(&cache, below_0x100);
+	for (int i = 0 ; i < RESPONSE_CACHE_ENTRIES ; i++) {
+		read_request(req, 1, i, 1);
+		response_cache_store(&cache, 1, req, sizeof(req), encoded, sizeof(encoded));
+	}
+	// Use the first, so the second is evicted by a new range
+	read_request(req, 1, 0, 1);
+	zassert_true(response_cache_lookup(&cache, 1, req, sizeof(req), resp, sizeof(resp)) > 0);
+	read_request(req, 1, 0x80, 1);
+	response_cache_store(&cache, 1, req, sizeof(req), encoded, sizeof(encoded));
+
+	read_request(req, 1, 0, 1);
+	zassert_true(response_cache_lookup(&cache, 1, req, sizeof(req), resp, sizeof(resp)) > 0);
+	read_request(req, 1, 1, 1);
+	zassert_equal(response_cache_lookup(&cache, 1, req, sizeof(req), resp, sizeof(resp)), 0);
+	read_request(req, 1, 0x80, 1);
+	zassert_true(response_cache_lookup(&cache, 1, req, sizeof(req), resp, sizeof(resp)) > 0);
+}
@@ -0,0 +1,184 @@
+#include <regex.h>
+#include "lib/snapshot.h"
+#include "lib/cbor.h"
+
+#include <zephyr/ztest.h>
+
+ZTEST_SUITE(snapshot_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct value_store store;
+static struct snapshot_base base;
+static struct snapshot snapshot;
+static uint8_t buf[SNAPSHOT_MAX_LENGTH];
+
+static void set(enum Item item, int64_t value) {
+	struct data_item data = { .item = item };
+	data_item_set_numeric_value(&data, value);
+	value_store_update(&store, &data);
+}
+
+// Values of a household meter, 12 MWh in and 3 MWh out
+static void fill_store(void) {
+	struct data_item date_time = { DATE_TIME, { .date_time = "230615123000S" }};
+
+	value_store_init(&store);
+	value_store_update(&store, &date_time);
+	set(METER_ACTIVE_ENERGY_IN, 12345678);
+	set(METER_ACTIVE_ENERGY_OUT, 3456789);
+	set(METER_REACTIVE_ENERGY_IN, 456789);
+	set(METER_REACTIVE_ENERGY_OUT, 1234567);
+	set(ACTIVE_ENERGY_IN, 1234);
+	set(ACTIVE_ENERGY_OUT, 0);
+	set(REACTIVE_ENERGY_IN, 56);
+	set(REACTIVE_ENERGY_OUT, 0);
+	for (enum Item item = FIRST_VIRTUAL_ITEM ; item < NET_ACTIVE_ENERGY ; item++) {
+		set(item, 1200 + item);
+	}
+	set(NET_ACTIVE_ENERGY, -1234);
+	set(METER_NET_ACTIVE_ENERGY, 12345678 - 3456789);
+	store.generation = 42;
+}
+
+static uint64_t valued_items(void) {
+	uint64_t items = 0;
+	for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+		if (store.rows[i].last_updated != NEVER_UPDATED) {
+			items |= BIT64(i);
+		}
+	}
+	return items;
+}
+
+static void assert_decoded(uint64_t items) {
+	int64_t expected, value;
+
+	zassert_equal(snapshot.items, items);
+	for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+		if (!(items & BIT64(i))) {
+			continue;
+		}
+		zassert_equal(snapshot.rows[i].data.item, i);
+		if (i == DATE_TIME) {
+			zassert_mem_equal(snapshot.rows[i].data.value.date_time, store.rows[i].data.value.date_time, 13);
+			continue;
+		}
+		zassert_ok(data_item_numeric_value(&store.rows[i].data, &expected));
+		zassert_ok(data_item_numeric_value(&snapshot.rows[i].data, &value));
+		zassert_equal(value, expected);
+	}
+}
+
+ZTEST(snapshot_suite, test_round_trip)
+{
+	int len;
+
+	fill_store();
+	store.rows[METER_ACTIVE_ENERGY_IN].last_updated = -5000;
+	len = snapshot_encode(&store, ~0ULL, NULL, SNAPSHOT_FLAG_AGES, 1000, buf, sizeof(buf));
+	zassert_true(len > SNAPSHOT_HEADER_LENGTH);
+	zassert_equal(buf[0], SNAPSHOT_MAGIC);
+	zassert_equal(buf[1], SNAPSHOT_VERSION);
+
+	zassert_equal(snapshot_decode(buf, len, NULL, &snapshot), 0);
+	zassert_equal(snapshot.generation, 42);
+	zassert_equal(snapshot.flags, SNAPSHOT_FLAG_AGES);
+	zassert_equal(snapshot.unresolved, 0);
+	// Items never updated are omitted
+	assert_decoded(valued_items());
+	zassert_false(snapshot.items & BIT64(DEMAND_AVERAGE));
+	zassert_equal(strcmp(snapshot.rows[DATE_TIME].data.value.date_time, "230615123000S"), 0);
+	zassert_equal(snapshot.rows[NET_ACTIVE_ENERGY].data.value.double_long_signed, -1234);
+	zassert_equal(snapshot.rows[METER_ACTIVE_ENERGY_IN].last_updated, -6000);
+
+	// Only the items asked for, without ages
+	len = snapshot_encode(&store, BIT64(ACTIVE_ENERGY_IN) | BIT64(DEMAND_AVERAGE), NULL, 0, 0, buf, sizeof(buf));
+	zassert_equal(len, SNAPSHOT_HEADER_LENGTH + 3);
+	zassert_equal(snapshot_decode(buf, len, NULL, &snapshot), 0);
+	assert_decoded(BIT64(ACTIVE_ENERGY_IN));
+	zassert_equal(snapshot.rows[ACTIVE_ENERGY_IN].last_updated, 0);
+
+	zassert_equal(snapshot_encode(&store, ~0ULL, NULL, 0, 0, buf, 16), -ENOMEM);
+}
+
+ZTEST(snapshot_suite, test_malformed)
+{
+	int len;
+
+	fill_store();
+	len = snapshot_encode(&store, BIT64(METER_ACTIVE_ENERGY_IN), NULL, 0, 0, buf, sizeof(buf));
+	zassert_equal(snapshot_decode(buf, len - 1, NULL, &snapshot), -EINVAL);
+	buf[len] = 0;
+	zassert_equal(snapshot_decode(buf, len + 1, NULL, &snapshot), -EINVAL);
+	buf[1] = SNAPSHOT_VERSION + 1;
+	zassert_equal(snapshot_decode(buf, len, NULL, &snapshot), -ENOTSUP);
+	buf[0] = 'P';
+	zassert_equal(snapshot_decode(buf, len, NULL, &snapshot), -EINVAL);
+}
+
+ZTEST(snapshot_suite, test_counters_relative_to_base)
+{
+	int len;
+
+	fill_store();
+	snapshot_base_init(&base, store.generation);
+	for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+		snapshot_base_put(&base, &store.rows[i].data);
+	}
+	zassert_equal(base.items, BIT64(METER_ACTIVE_ENERGY_IN) | BIT64(METER_ACTIVE_ENERGY_OUT) |
+		      BIT64(METER_REACTIVE_ENERGY_IN) | BIT64(METER_REACTIVE_ENERGY_OUT) |
+		      BIT64(METER_NET_ACTIVE_ENERGY));
+
+	set(METER_ACTIVE_ENERGY_IN, 12345678 + 25);
+	set(ACTIVE_ENERGY_IN, 1500);
+	store.generation = 43;
+	len = snapshot_encode(&store, BIT64(METER_ACTIVE_ENERGY_IN) | BIT64(ACTIVE_ENERGY_IN), &base, 0, 0,
+			      buf, sizeof(buf));
+	// Counter record of a byte and a byte of delta
+	zassert_equal(len, SNAPSHOT_DELTA_HEADER_LENGTH + 2 + 3);
+
+	zassert_equal(snapshot_decode(buf, len, &base, &snapshot), 0);
+	zassert_equal(snapshot.flags, SNAPSHOT_FLAG_DELTA);
+	zassert_equal(snapshot.base_generation, 42);
+	assert_decoded(BIT64(METER_ACTIVE_ENERGY_IN) | BIT64(ACTIVE_ENERGY_IN));
+
+	// Counters stay unresolved without the right base, other items do not
+	zassert_equal(snapshot_decode(buf, len, NULL, &snapshot), 0);
+	assert_decoded(BIT64(ACTIVE_ENERGY_IN));
+	zassert_equal(snapshot.unresolved, BIT64(METER_ACTIVE_ENERGY_IN));
+	base.generation = 41;
+	zassert_equal(snapshot_decode(buf, len, &base, &snapshot), 0);
+	zassert_equal(snapshot.unresolved, BIT64(METER_ACTIVE_ENERGY_IN));
+}
+
+// Sizes of all items of a telegram, in the encodings of the store
+ZTEST(snapshot_suite, test_size)
+{
+	int items = 0, numeric = 0;
+	int full, delta, cbor;
+	int64_t value;
+
+	fill_store();
+	for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+		if (valued_items() & BIT64(i)) {
+			items++;
+			numeric += data_item_numeric_value(&store.rows[i].data, &value) == 0;
+		}
+	}
+
+	full = snapshot_encode(&store, ~0ULL, NULL, 0, 0, buf, sizeof(buf));
+	snapshot_base_init(&base, store.generation);
+	for (int i = 0 ; i < _ITEM_COUNT ; i++) {
+		snapshot_base_put(&base, &store.rows[i].data);
+	}
+	set(METER_ACTIVE_ENERGY_IN, 12345678 + 1234);
+	delta = snapshot_encode(&store, ~0ULL, &base, 0, 0, buf, sizeof(buf));
+	cbor = cbor_encode_snapshot(&store, buf, sizeof(buf));
+
+	TC_PRINT("%d items: rows %d, registers %d, uint8 item and int32 value %d, CBOR %d, "
+		 "snapshot %d, relative to a base %d bytes\n", items, (int) sizeof(store.rows),
+		 (int) sizeof(store.registers), 8 + numeric * 5, cbor, full, delta);
+	zassert_true(full < cbor);
+	zassert_true(full < 8 + numeric * 5);
+	zassert_true(delta < full);
+	zassert_true(full * 4 < (int) sizeof(store.rows));
+}
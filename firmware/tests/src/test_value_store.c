@@ -0,0 +1,156 @@
+#include <regex.h>
+#include "lib/value_store.h"
+#include "lib/openp1.h"
+
+#include <zephyr/ztest.h>
+#include <zephyr/sys/byteorder.h>
+
+ZTEST_SUITE(value_store_suite, NULL, NULL, NULL, NULL, NULL);
+
+static struct value_store store;
+
+ZTEST(value_store_suite, test_empty_is_stale)
+{
+	uint8_t reg[2];
+	// Tests run within BEST_BEFORE_MS of boot, where an unset row must not look recent
+	value_store_init(&store);
+	zassert_false(value_store_is_fresh(&store, METER_ACTIVE_ENERGY_IN));
+	zassert_equal(value_store_read_registers(&store, METER_ACTIVE_ENERGY_IN, 0, 1, reg), STALE);
+	zassert_equal(value_store_read(&store, METER_ACTIVE_ENERGY_IN).status, STALE);
+}
+
+ZTEST(value_store_suite, test_register_image)
+{
+	struct data_item energy = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 0x12345678 }};
+	struct data_item date_time = { DATE_TIME, { .date_time = "210222161900W" }};
+	uint8_t regs[VALUE_STORE_MAX_ITEM_REGISTERS * 2];
+
+	value_store_init(&store);
+	value_store_update(&store, &energy);
+	value_store_update(&store, &date_time);
+
+	zassert_equal(value_store_item_registers(METER_ACTIVE_ENERGY_IN), 2);
+	zassert_equal(value_store_item_registers(DATE_TIME), 7);
+
+	zassert_equal(value_store_read_registers(&store, METER_ACTIVE_ENERGY_IN, 0, 2, regs), OK);
+	zassert_equal(sys_get_be16(&regs[0]), 0x1234);
+	zassert_equal(sys_get_be16(&regs[2]), 0x5678);
+
+	zassert_equal(value_store_read_registers(&store, METER_ACTIVE_ENERGY_IN, 1, 1, regs), OK);
+	zassert_equal(sys_get_be16(&regs[0]), 0x5678);
+
+	zassert_equal(value_store_read_registers(&store, DATE_TIME, 0, 7, regs), OK);
+	zassert_mem_equal(regs, "210222161900W", 14);
+}
+
+ZTEST(value_store_suite, test_register_bounds)
+{
+	struct data_item energy = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 1 }};
+	uint8_t regs[VALUE_STORE_MAX_ITEM_REGISTERS * 2];
+
+	value_store_init(&store);
+	value_store_update(&store, &energy);
+
+	zassert_equal(value_store_read_registers(&store, METER_ACTIVE_ENERGY_IN, 1, 2, regs), INVALID);
+	zassert_equal(value_store_read_registers(&store, METER_ACTIVE_ENERGY_IN, 2, 1, regs), INVALID);
+	zassert_equal(value_store_read_registers(&store, _ITEM_COUNT, 0, 1, regs), INVALID);
+	zassert_equal(value_store_read_registers(&store, METER_ACTIVE_ENERGY_OUT, 0, 1, regs), STALE);
+}
+
+ZTEST(value_store_suite, test_history_of_numeric_items)
+{
+	struct data_item power = { ACTIVE_ENERGY_IN, { .double_long_unsigned = 1000 }};
+	struct data_item date_time = { DATE_TIME, { .date_time = "210222161900W" }};
+	struct history_sample samples[HISTORY_DEPTH];
+
+	value_store_init(&store);
+	for (int i = 0 ; i < 3 ; i++) {
+		power.value.double_long_unsigned = 1000 + i;
+		value_store_update(&store, &power);
+	}
+	value_store_update(&store, &date_time);
+
+	zassert_equal(value_store_read_history(&store, ACTIVE_ENERGY_IN, 0, samples, HISTORY_DEPTH), 3);
+	zassert_equal(samples[2].value, 1002);
+	zassert_equal(value_store_read_history(&store, DATE_TIME, 0, samples, HISTORY_DEPTH), 0);
+	zassert_true(value_store_read_history(&store, _ITEM_COUNT, 0, samples, HISTORY_DEPTH) < 0);
+}
+
+ZTEST(value_store_suite, test_restore_keeps_age)
+{
+	static struct value_store restored;
+	struct data_item energy = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 0x12345678 }};
+	struct history_sample samples[HISTORY_DEPTH];
+	int64_t now = k_uptime_get();
+	int64_t saved_at = now + 5000;
+	uint8_t regs[4];
+
+	value_store_init(&store);
+	value_store_update(&store, &energy);
+
+	// Snapshot relative to the time it is taken, restored shortly after a reboot
+	value_store_copy(&store, &restored);
+	value_store_rebase_rows(restored.rows, _ITEM_COUNT, -saved_at);
+	history_rebase(&restored.history[METER_ACTIVE_ENERGY_IN], -saved_at);
+	value_store_restore(&restored, now);
+
+	zassert_equal(restored.rows[METER_ACTIVE_ENERGY_IN].last_updated, now - 5000);
+	zassert_equal(restored.rows[METER_ACTIVE_ENERGY_OUT].last_updated, NEVER_UPDATED);
+	zassert_mem_equal(restored.registers[METER_ACTIVE_ENERGY_IN], store.registers[METER_ACTIVE_ENERGY_IN],
+			  sizeof(store.registers[0]));
+
+	zassert_equal(value_store_read_history(&restored, METER_ACTIVE_ENERGY_IN, INT64_MIN, samples, HISTORY_DEPTH), 1);
+	zassert_equal(samples[0].timestamp, now - 5000);
+
+	// Values from before the reboot are never fresh, their registers are read as
+	// restored until the meter sends them again
+	zassert_false(value_store_is_fresh(&restored, METER_ACTIVE_ENERGY_IN));
+	zassert_true(value_store_is_restored(&restored, METER_ACTIVE_ENERGY_IN));
+	zassert_false(value_store_is_restored(&restored, METER_ACTIVE_ENERGY_OUT));
+	zassert_equal(restored.last_telegram, now - 5000);
+	zassert_equal(value_store_read(&restored, METER_ACTIVE_ENERGY_IN).status, STALE);
+	zassert_equal(value_store_read_registers(&restored, METER_ACTIVE_ENERGY_IN, 0, 2, regs), RESTORED);
+	zassert_equal(sys_get_be16(&regs[2]), 0x5678);
+	zassert_equal(value_store_read_registers(&restored, METER_ACTIVE_ENERGY_OUT, 0, 2, regs), STALE);
+	value_store_update(&restored, &energy);
+	zassert_false(value_store_is_restored(&restored, METER_ACTIVE_ENERGY_IN));
+	zassert_equal(value_store_read_registers(&restored, METER_ACTIVE_ENERGY_IN, 0, 2, regs), OK);
+}
+
+ZTEST(value_store_suite, test_generation_changes_with_telegram)
+{
+	struct data_item energy = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 1 }};
+	struct telegram *telegram = telegram_init();
+
+	value_store_init(&store);
+	uint32_t generation = store.generation;
+
+	value_store_expire(&store);
+	zassert_equal(store.generation, generation);
+
+	zassert_not_null(telegram);
+	telegram_item_append(telegram, &energy);
+	value_store_apply(&store, telegram);
+	telegram_free(telegram);
+	zassert_not_equal(store.generation, generation);
+}
+
+ZTEST(value_store_suite, test_next_expiry)
+{
+	struct data_item energy = { METER_ACTIVE_ENERGY_IN, { .double_long_unsigned = 1 }};
+
+	value_store_init(&store);
+	zassert_equal(value_store_next_expiry(&store), INT64_MAX);
+
+	value_store_update(&store, &energy);
+	int64_t expiry = value_store_next_expiry(&store);
+	zassert_equal(expiry, store.rows[METER_ACTIVE_ENERGY_IN].last_updated + BEST_BEFORE_MS + 1);
+
+	// Expiring at that time turns the item stale, a new generation
+	store.rows[METER_ACTIVE_ENERGY_IN].last_updated -= expiry - k_uptime_get();
+	uint32_t generation = store.generation;
+	value_store_expire(&store);
+	zassert_false(value_store_is_fresh(&store, METER_ACTIVE_ENERGY_IN));
+	zassert_not_equal(store.generation, generation);
+	zassert_equal(value_store_next_expiry(&store), INT64_MAX);
+}